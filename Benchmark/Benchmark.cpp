@@ -0,0 +1,97 @@
+#include "../Octree/Octree.hpp"
+#include "../Container/Container.hpp"
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <string>
+
+
+using Clock = std::chrono::steady_clock;
+
+struct Workload{
+    std::string name;
+    BoundingBox<Point<int>> bounds;
+    std::vector<std::pair<std::shared_ptr<Container>, Point<int>>> items;
+    std::vector<BoundingBox<Point<int>>> queries;
+};
+
+// Rows of 20ft and 40ft containers stacked up to four high on a large yard.
+Workload yard(){
+    Workload work{"yard", BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(2048, 512, 16)), {}, {}};
+    std::mt19937 random(1);
+    for(int row = 0; row < 40; ++row){
+        int x = 1;
+        while(true){
+            int length = random() % 2 == 0 ? 20 : 40;
+            if(x + length >= 2048){
+                break;
+            }
+            for(int tier = 0; tier < 4; ++tier){
+                work.items.emplace_back(std::make_shared<Container>("_", "Yard", length, 8, 3, 1.0, 1.0), Point<int>(x, 1 + row * 12, 1 + tier * 4));
+            }
+            x += length + 2;
+        }
+    }
+    for(int i = 0; i < 20000; ++i){
+        int x = 1 + random() % 2000, y = 1 + random() % 480;
+        work.queries.emplace_back(Point<int>(x, y, 1), Point<int>(x + 40, y + 8, 15));
+    }
+    return work;
+}
+
+// Small parcels packed tightly along a few shelves of a tall rack.
+Workload rack(){
+    Workload work{"rack", BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(1024, 1024, 256)), {}, {}};
+    std::mt19937 random(2);
+    for(int shelf = 0; shelf < 6; ++shelf){
+        int y = 1 + shelf * 40;
+        for(int x = 1; x + 3 < 600; x += 4){
+            for(int z = 1; z + 3 < 40; z += 4){
+                work.items.emplace_back(std::make_shared<Container>("_", "Rack", 3, 3, 3, 1.0, 1.0), Point<int>(x, y, z));
+            }
+        }
+    }
+    for(int i = 0; i < 20000; ++i){
+        int x = 1 + random() % 600, y = 1 + random() % 240, z = 1 + random() % 40;
+        work.queries.emplace_back(Point<int>(x, y, z), Point<int>(x + 6, y + 6, z + 6));
+    }
+    return work;
+}
+
+template<typename Policy>
+void run(const char* preset, const Workload& work){
+    Octree<Point<int>, std::shared_ptr<Container>, PointerLayout, Policy> octree(work.bounds);
+    auto start = Clock::now();
+    size_t placed = 0;
+    for(const auto& item : work.items){
+        placed += octree.push(item.first, item.second);
+    }
+    double insertSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    size_t hits = 0;
+    for(const auto& query : work.queries){
+        octree.queryRange(query, [&](const BoundingBox<Point<int>>&, const std::shared_ptr<Container>&){
+            ++hits;
+            return true;
+        });
+    }
+    double querySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << std::left << std::setw(8) << work.name << std::setw(8) << preset
+              << std::right << std::setw(10) << placed << std::setw(10) << octree.nodeCount()
+              << std::setw(14) << std::fixed << std::setprecision(0) << placed / insertSeconds
+              << std::setw(14) << work.queries.size() / querySeconds
+              << std::setw(12) << hits << std::endl;
+}
+
+int main(){
+    std::cout << std::left << std::setw(8) << "work" << std::setw(8) << "preset"
+              << std::right << std::setw(10) << "items" << std::setw(10) << "nodes"
+              << std::setw(14) << "inserts/s" << std::setw(14) << "queries/s" << std::setw(12) << "hits" << std::endl;
+    for(const Workload& work : {yard(), rack()}){
+        run<OctreePolicy<>>("default", work);
+        run<YardOctreePolicy>("yard", work);
+        run<RackOctreePolicy>("rack", work);
+    }
+}
@@ -46,6 +46,22 @@ public:
         }
     }
 
+    /**
+     * @brief Run all checks without letting a rejection escape.
+     * @return True if every check accepted the position, otherwise false.
+     */
+    bool tryChecks(Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<T>> position) const {
+        if (checkFunctions.empty()) {
+            return true;
+        }
+        try {
+            applyChecks(storage, container, position);
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
 };
 
 
@@ -0,0 +1,233 @@
+#ifndef CONCURRENTOCTREE_HPP
+#define CONCURRENTOCTREE_HPP
+
+
+#include "Octree.hpp"
+#include <mutex>
+#include <shared_mutex>
+
+/**
+ * @class ConcurrentOctree
+ * @brief Octree that can be changed from several threads, locking only the regions it touches.
+ *
+ * The floor of the bounds is cut into a grid of regions (columns over the
+ * whole height). An item lying inside one region is stored in that region's
+ * own octree; items crossing a region border go to a shared spanning octree.
+ * Items of different regions cannot overlap, so placing an item takes the
+ * lock of its region exclusively and the spanning lock shared, and placements
+ * in different regions run in parallel. Placing a spanning item takes every
+ * region it covers shared and the spanning lock exclusively. Locks are always
+ * taken in region order with the spanning lock last.
+ *
+ * Every item is visited under its region's lock, but a whole-tree read is not
+ * a snapshot: items placed in other regions meanwhile may or may not be seen.
+ * Coordinates must be integers.
+ *
+ * @tparam T Type representing points in 3D space.
+ * @tparam N Type associated with the objects to be stored in the octree.
+ */
+
+template <typename T, typename N>
+class ConcurrentOctree{
+    private:
+        using Coordinate = std::decay_t<decltype(T::x)>;
+        using Tree = Octree<T, N>;
+        static_assert(std::is_integral_v<Coordinate>, "Concurrent octree needs integer coordinates");
+
+        struct Region{
+            mutable std::shared_mutex mtx;
+            Tree tree;
+            Region(const BoundingBox<T>& bounds, double looseness) : tree(bounds, looseness) {}
+        };
+
+        BoundingBox<T> bounds;
+        size_t stripes;
+        std::vector<std::unique_ptr<Region>> regions;
+        std::unique_ptr<Region> spanning;
+
+        size_t stripe(Coordinate v, Coordinate lo, Coordinate hi) const{
+            if(v <= lo){
+                return 0;
+            }
+            size_t index = static_cast<size_t>(v - lo) * stripes / (static_cast<size_t>(hi - lo) + 1);
+            return std::min(index, stripes - 1);
+        }
+
+        struct Cover{
+            size_t x0, x1, y0, y1;
+            bool single() const{
+                return x0 == x1 && y0 == y1;
+            }
+        };
+
+        Cover coverOf(const BoundingBox<T>& box) const{
+            return Cover{stripe(box.min.x, bounds.min.x, bounds.max.x), stripe(box.max.x, bounds.min.x, bounds.max.x),
+                         stripe(box.min.y, bounds.min.y, bounds.max.y), stripe(box.max.y, bounds.min.y, bounds.max.y)};
+        }
+
+        Region& regionAt(size_t x, size_t y) const{
+            return *regions[y * stripes + x];
+        }
+
+    public:
+    /**
+     * @brief Create an empty concurrent octree.
+     * @param bbox Bounding box covered by the octree.
+     * @param stripes Number of regions along X and along Y, at least 1.
+     * @param looseness Looseness of the octree of every region.
+     * @throws std::invalid_argument If stripes is 0 or the looseness is below 1.
+     */
+        explicit ConcurrentOctree(BoundingBox<T> bbox, size_t stripes = 4, double looseness = 1.0) : bounds(bbox), stripes(stripes) {
+            if(stripes == 0){
+                throw std::invalid_argument("Concurrent octree needs at least one region");
+            }
+            // Every region tree covers the whole bounds; regions only decide which tree holds an item.
+            for(size_t i = 0; i < stripes * stripes; ++i){
+                regions.push_back(std::make_unique<Region>(bbox, looseness));
+            }
+            spanning = std::make_unique<Region>(bbox, looseness);
+        }
+
+        ConcurrentOctree(const ConcurrentOctree&) = delete;
+        ConcurrentOctree& operator=(const ConcurrentOctree&) = delete;
+
+        const BoundingBox<T>& getBounds() const{
+            return bounds;
+        }
+
+        size_t regionCount() const{
+            return regions.size();
+        }
+
+    /**
+     * @brief Push a container into the octree at a specified point.
+     * @param container The container to be pushed into the octree.
+     * @param p The point (coordinates) where the container should be inserted.
+     * @return True if the push operation is successful, otherwise false.
+     */
+        bool push(N container, T p){
+            BoundingBox<T> box = Tree::calculateBounds(p.x, p.y, p.z, container);
+            Cover cover = coverOf(box);
+            if(cover.single()){
+                Region& region = regionAt(cover.x0, cover.y0);
+                std::unique_lock<std::shared_mutex> lock(region.mtx);
+                std::shared_lock<std::shared_mutex> spanLock(spanning->mtx);
+                if(spanning->tree.checkCollisions(container, p)){
+                    return false;
+                }
+                return region.tree.push(container, p);
+            }
+            std::vector<std::shared_lock<std::shared_mutex>> locks;
+            for(size_t y = cover.y0; y <= cover.y1; ++y){
+                for(size_t x = cover.x0; x <= cover.x1; ++x){
+                    locks.emplace_back(regionAt(x, y).mtx);
+                }
+            }
+            std::unique_lock<std::shared_mutex> spanLock(spanning->mtx);
+            for(size_t y = cover.y0; y <= cover.y1; ++y){
+                for(size_t x = cover.x0; x <= cover.x1; ++x){
+                    if(regionAt(x, y).tree.checkCollisions(container, p)){
+                        return false;
+                    }
+                }
+            }
+            return spanning->tree.push(container, p);
+        }
+
+    /**
+     * @brief Remove a container from the octree.
+     * @param p Anchor of the container to be removed.
+     * @return True if the removal was successful, otherwise false.
+     */
+        bool remove(const T& p){
+            Region& region = regionAt(stripe(p.x, bounds.min.x, bounds.max.x), stripe(p.y, bounds.min.y, bounds.max.y));
+            {
+                std::unique_lock<std::shared_mutex> lock(region.mtx);
+                if(region.tree.remove(p)){
+                    return true;
+                }
+            }
+            std::unique_lock<std::shared_mutex> spanLock(spanning->mtx);
+            return spanning->tree.remove(p);
+        }
+
+    /**
+     * @brief Search for a specific container based on its anchor.
+     * @param p Anchor of the container to search for.
+     * @return A pair of ContainerPosition and associated data.
+     * @throws std::invalid_argument if the item is not found.
+     */
+        std::pair<ContainerPosition<T>, N> search(const T& p) const{
+            Region& region = regionAt(stripe(p.x, bounds.min.x, bounds.max.x), stripe(p.y, bounds.min.y, bounds.max.y));
+            {
+                std::shared_lock<std::shared_mutex> lock(region.mtx);
+                try{
+                    return region.tree.search(p);
+                }catch(const std::invalid_argument&){
+                }
+            }
+            std::shared_lock<std::shared_mutex> spanLock(spanning->mtx);
+            return spanning->tree.search(p);
+        }
+
+        bool checkCollisions(N container, const T& p) const{
+            BoundingBox<T> box = Tree::calculateBounds(p.x, p.y, p.z, container);
+            if(!bounds.contains(box)){
+                return true;
+            }
+            return !queryRange(box, [](const BoundingBox<T>&, const N&){
+                return false;
+            });
+        }
+
+    /**
+     * @brief Visit every stored item whose bounds overlap a range.
+     *
+     * Regions are visited one at a time under a shared lock, the visitor must
+     * not change this octree.
+     *
+     * @param range Inclusive box to query.
+     * @param visit Callable taking (const BoundingBox<T>&, const N&), returns false to stop.
+     * @return False if the visitor stopped the traversal early, otherwise true.
+     */
+        template<typename Visitor>
+        bool queryRange(const BoundingBox<T>& range, Visitor&& visit) const{
+            Cover cover = coverOf(range);
+            for(size_t y = cover.y0; y <= cover.y1; ++y){
+                for(size_t x = cover.x0; x <= cover.x1; ++x){
+                    const Region& region = regionAt(x, y);
+                    std::shared_lock<std::shared_mutex> lock(region.mtx);
+                    if(!region.tree.queryRange(range, visit)){
+                        return false;
+                    }
+                }
+            }
+            std::shared_lock<std::shared_mutex> spanLock(spanning->mtx);
+            return spanning->tree.queryRange(range, visit);
+        }
+
+    /**
+     * @brief Get every stored item, region by region.
+     * @return Vector of pairs of ContainerPosition and associated data.
+     */
+        std::vector<std::pair<ContainerPosition<T>, N>> searchDepth() const{
+            std::vector<std::pair<ContainerPosition<T>, N>> result;
+            queryRange(bounds, [&](const BoundingBox<T>& box, const N& payload){
+                result.emplace_back(Tree::positionOf(box), payload);
+                return true;
+            });
+            return result;
+        }
+
+        size_t size() const{
+            size_t count = 0;
+            queryRange(bounds, [&](const BoundingBox<T>&, const N&){
+                ++count;
+                return true;
+            });
+            return count;
+        }
+};
+
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef LINEAROCTREE_HPP
+#define LINEAROCTREE_HPP
+
+
+#include "Octree.hpp"
+
+/**
+ * @class Octree<T, N, LinearLayout>
+ * @brief Linear octree: all items in one flat array sorted by Morton code.
+ *
+ * The bounds are covered by a grid of 2^depth points per axis anchored at the
+ * minimum corner. Every item is assigned the smallest grid-aligned cell holding
+ * both of its corners and keyed by the Morton code of that cell's first point
+ * and the cell level. Sorting by this key lays out every subtree as one
+ * contiguous run, so range queries skip whole subtrees with a binary search and
+ * scan the rest sequentially. Geometry is kept in NodeItems arrays with the keys
+ * in a parallel array, so the layout holds no pointers and is trivially
+ * serializable. Coordinates must be integers. The policy is not used, the
+ * linear layout has no leaves to split.
+ *
+ * @tparam T Type representing points in 3D space.
+ * @tparam N Type associated with the objects to be stored in the octree.
+ */
+
+template <typename T, typename N, typename Policy>
+class Octree<T, N, LinearLayout, Policy>{
+    public:
+        using Item = std::pair<BoundingBox<T>, N>;
+
+    private:
+        using Coordinate = std::decay_t<decltype(T::x)>;
+        using Pointer = Octree<T, N, PointerLayout, Policy>;
+        static_assert(std::is_integral_v<Coordinate>, "Linear octree needs integer coordinates");
+
+        static constexpr unsigned MAX_DEPTH = 21;
+
+        struct Key{
+            std::uint64_t code;
+            std::uint8_t level;
+            bool operator<(const Key& other) const{
+                return code < other.code || (code == other.code && level < other.level);
+            }
+        };
+
+        BoundingBox<T> bounds;
+        unsigned depth = 0;
+        std::vector<Key> keys;
+        NodeItems<T, N> items;
+
+        Key keyOf(const BoundingBox<T>& box) const{
+            std::uint64_t x0 = box.min.x - bounds.min.x, y0 = box.min.y - bounds.min.y, z0 = box.min.z - bounds.min.z;
+            std::uint64_t x1 = box.max.x - bounds.min.x, y1 = box.max.y - bounds.min.y, z1 = box.max.z - bounds.min.z;
+            unsigned shift = 0;
+            while(shift < depth && ((x0 >> shift) != (x1 >> shift) || (y0 >> shift) != (y1 >> shift) || (z0 >> shift) != (z1 >> shift))){
+                ++shift;
+            }
+            return Key{mortonEncode(x0 >> shift << shift, y0 >> shift << shift, z0 >> shift << shift), static_cast<std::uint8_t>(depth - shift)};
+        }
+
+        size_t find(const T& p) const{
+            if(p.x < bounds.min.x || p.y < bounds.min.y || p.z < bounds.min.z ||
+               p.x > bounds.max.x || p.y > bounds.max.y || p.z > bounds.max.z){
+                return items.size();
+            }
+            std::uint64_t x = p.x - bounds.min.x, y = p.y - bounds.min.y, z = p.z - bounds.min.z;
+            // The item's cell is one of the cells containing its anchor, one per level.
+            for(unsigned level = 0; level <= depth; ++level){
+                unsigned shift = depth - level;
+                Key key{mortonEncode(x >> shift << shift, y >> shift << shift, z >> shift << shift), static_cast<std::uint8_t>(level)};
+                auto range = std::equal_range(keys.begin(), keys.end(), key);
+                for(auto it = range.first; it != range.second; ++it){
+                    size_t i = it - keys.begin();
+                    if(items.anchor(i) == p){
+                        return i;
+                    }
+                }
+            }
+            return items.size();
+        }
+
+        template<typename Visitor>
+        bool queryCell(unsigned level, std::uint64_t code, const T& corner, size_t lo, size_t hi, const BoundingBox<T>& range, Visitor& visit) const{
+            if(lo == hi){
+                return true;
+            }
+            Coordinate side = Coordinate(1) << (depth - level);
+            BoundingBox<T> cell(corner, T(corner.x + side - 1, corner.y + side - 1, corner.z + side - 1));
+            if(!cell.intersects(range)){
+                return true;
+            }
+            size_t i = lo;
+            for(; i < hi && keys[i].code == code && keys[i].level == level; ++i){
+                if(items.intersects(i, range) && !visit(items.box(i), items.payload(i))){
+                    return false;
+                }
+            }
+            if(level == depth){
+                return true;
+            }
+            std::uint64_t childSpan = std::uint64_t(1) << (3 * (depth - level - 1));
+            Coordinate half = side / 2;
+            for(std::uint64_t c = 0; c < 8 && i < hi; ++c){
+                std::uint64_t childCode = code + c * childSpan;
+                size_t childHi = std::lower_bound(keys.begin() + i, keys.begin() + hi, Key{childCode + childSpan, 0}) - keys.begin();
+                T childCorner(corner.x + (c & 1 ? half : 0), corner.y + (c & 2 ? half : 0), corner.z + (c & 4 ? half : 0));
+                if(!queryCell(level + 1, childCode, childCorner, i, childHi, range, visit)){
+                    return false;
+                }
+                i = childHi;
+            }
+            return true;
+        }
+
+        bool checkCollision(const BoundingBox<T>& box) const{
+            return !queryRange(box, [](const BoundingBox<T>&, const N&){
+                return false;
+            });
+        }
+
+    public:
+        Octree(){}
+    /**
+     * @brief Create an empty linear octree.
+     * @param bbox Bounding box covered by the octree.
+     * @throws std::invalid_argument If an edge of the box is longer than 2^21 - 1.
+     */
+        explicit Octree(BoundingBox<T> bbox) : bounds(bbox) {
+            Coordinate extent = std::max({bbox.max.x - bbox.min.x, bbox.max.y - bbox.min.y, bbox.max.z - bbox.min.z});
+            while(depth < MAX_DEPTH && (Coordinate(1) << depth) <= extent){
+                ++depth;
+            }
+            if((Coordinate(1) << depth) <= extent){
+                throw std::invalid_argument("Bounds are too large for the linear octree");
+            }
+        }
+
+        static BoundingBox<T> calculateBounds(Coordinate x, Coordinate y, Coordinate z, N container){
+            return Pointer::calculateBounds(x, y, z, container);
+        }
+
+        static ContainerPosition<T> calculateContainerPosition(Coordinate x, Coordinate y, Coordinate z, N container){
+            return Pointer::calculateContainerPosition(x, y, z, container);
+        }
+
+        static ContainerPosition<T> positionOf(const BoundingBox<T>& box){
+            return Pointer::positionOf(box);
+        }
+
+        const BoundingBox<T>& getBounds() const{
+            return bounds;
+        }
+
+        size_t size() const{
+            return items.size();
+        }
+
+        Octree Clone() const{
+            return *this;
+        }
+
+    /**
+     * @brief Push a container into the octree at a specified point.
+     * @param container The container to be pushed into the octree.
+     * @param p The point (coordinates) where the container should be inserted.
+     * @return True if the push operation is successful, otherwise false.
+     */
+        bool push(N container, T p){
+            BoundingBox<T> box = calculateBounds(p.x, p.y, p.z, container);
+            if(!bounds.contains(box) || checkCollision(box)){
+                return false;
+            }
+            Key key = keyOf(box);
+            size_t i = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+            keys.insert(keys.begin() + i, key);
+            items.insert(i, box, std::move(container));
+            return true;
+        }
+
+        bool SearchInsert(N container, const T& p) const{
+            BoundingBox<T> box = calculateBounds(p.x, p.y, p.z, container);
+            return bounds.contains(box) && !checkCollision(box);
+        }
+
+        bool checkCollisions(N container, const T& p) const{
+            BoundingBox<T> box = calculateBounds(p.x, p.y, p.z, container);
+            if(!bounds.contains(box)){
+                return true;
+            }
+            return checkCollision(box);
+        }
+
+    /**
+     * @brief Remove a container from the octree.
+     * @param p Anchor of the container to be removed.
+     * @return True if the removal was successful, otherwise false.
+     */
+        bool remove(const T& p){
+            size_t i = find(p);
+            if(i == items.size()){
+                return false;
+            }
+            keys.erase(keys.begin() + i);
+            items.erase(i);
+            return true;
+        }
+
+    /**
+     * @brief Search for a specific container based on its anchor.
+     * @param p Anchor of the container to search for.
+     * @return A pair of ContainerPosition and associated data.
+     * @throws std::invalid_argument if the item is not found.
+     */
+        std::pair<ContainerPosition<T>, N> search(const T& p) const{
+            size_t i = find(p);
+            if(i == items.size()){
+                throw std::invalid_argument("Item not found");
+            }
+            return std::make_pair(positionOf(items.box(i)), items.payload(i));
+        }
+
+    /**
+     * @brief Get every stored item in Morton order.
+     * @return Vector of pairs of ContainerPosition and associated data.
+     */
+        std::vector<std::pair<ContainerPosition<T>, N>> searchDepth() const{
+            std::vector<std::pair<ContainerPosition<T>, N>> result;
+            result.reserve(items.size());
+            for(size_t i = 0; i < items.size(); ++i){
+                result.emplace_back(positionOf(items.box(i)), items.payload(i));
+            }
+            return result;
+        }
+
+    /**
+     * @brief Visit every stored item whose bounds overlap a range.
+     * @param range Inclusive box to query.
+     * @param visit Callable taking (const BoundingBox<T>&, const N&), returns false to stop.
+     * @return False if the visitor stopped the traversal early, otherwise true.
+     */
+        template<typename Visitor>
+        bool queryRange(const BoundingBox<T>& range, Visitor&& visit) const{
+            return queryCell(0, 0, bounds.min, 0, items.size(), range, visit);
+        }
+
+    /**
+     * @brief Replace the contents with already placed items, sorting them once.
+     * @param loaded Bounds and payloads of the items; bounds must lie inside the octree.
+     */
+        void bulkLoad(std::vector<Item> loaded){
+            std::vector<std::pair<Key, size_t>> order(loaded.size());
+            for(size_t i = 0; i < loaded.size(); ++i){
+                order[i] = std::make_pair(keyOf(loaded[i].first), i);
+            }
+            std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b){
+                return a.first < b.first;
+            });
+            keys.clear();
+            items.clear();
+            keys.reserve(loaded.size());
+            items.reserve(loaded.size());
+            for(const auto& entry : order){
+                keys.push_back(entry.first);
+                items.push_back(loaded[entry.second].first, std::move(loaded[entry.second].second));
+            }
+        }
+};
+
+
+#endif
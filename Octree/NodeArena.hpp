@@ -0,0 +1,142 @@
+#ifndef NODEARENA_HPP
+#define NODEARENA_HPP
+
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <limits>
+#include <atomic>
+#include <array>
+
+/**
+ * @brief Index of a node inside a NodeArena.
+ */
+using NodeIndex = std::uint32_t;
+
+/**
+ * @brief Index used for a missing parent or child block.
+ */
+inline constexpr NodeIndex NO_NODE = std::numeric_limits<NodeIndex>::max();
+
+/**
+ * @class NodeArena
+ * @brief Pool of octree nodes handed out in blocks of eight siblings.
+ *
+ * Every block of eight nodes is allocated on its own and chunks of block
+ * pointers index them, so node addresses never change while the arena grows.
+ * Nodes are addressed by NodeIndex. Released blocks go to a free list and are
+ * reused by the next split; the blocks themselves are only freed together
+ * with the arena.
+ *
+ * Copying an arena shares its chunks. The first access to a node of a shared
+ * block through the non-const operator[] copies the chunk's block pointers and
+ * then the eight nodes of that block, so a copy costs one pointer per chunk
+ * plus one block per node that is modified later. Shared chunks and blocks are
+ * never written, so copies may be read from other threads while the original
+ * keeps changing.
+ *
+ * @tparam Node Default constructible node type.
+ */
+
+template<typename Node>
+class NodeArena{
+    public:
+        static constexpr NodeIndex BLOCK_SIZE = 8;
+
+    private:
+        static constexpr NodeIndex CHUNK_BLOCKS = 64;
+        static constexpr NodeIndex CHUNK_SIZE = BLOCK_SIZE * CHUNK_BLOCKS;
+
+        using Block = std::array<Node, BLOCK_SIZE>;
+        using Chunk = std::array<std::shared_ptr<Block>, CHUNK_BLOCKS>;
+
+        std::vector<std::shared_ptr<Chunk>> chunks;
+        std::vector<NodeIndex> freeBlocks;
+        NodeIndex used = 0;
+        size_t copied = 0;
+
+        Chunk& ownChunk(size_t chunk){
+            if(chunks[chunk].use_count() > 1){
+                chunks[chunk] = std::make_shared<Chunk>(*chunks[chunk]);
+            }
+            // Pairs with the release of the last other owner, which may live on another thread.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return *chunks[chunk];
+        }
+
+        Block& own(NodeIndex index){
+            std::shared_ptr<Block>& block = ownChunk(index / CHUNK_SIZE)[index % CHUNK_SIZE / BLOCK_SIZE];
+            if(block.use_count() > 1){
+                block = std::make_shared<Block>(*block);
+                copied += BLOCK_SIZE;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return *block;
+        }
+
+    public:
+        NodeArena(){}
+
+        /**
+         * @brief Get a node for modification, unsharing its chunk if needed.
+         * @param index Index of the node.
+         * @return Reference valid until the arena is destroyed or reassigned.
+         */
+        Node& operator[](NodeIndex index){
+            return own(index)[index % BLOCK_SIZE];
+        }
+
+        const Node& operator[](NodeIndex index) const{
+            return (*(*chunks[index / CHUNK_SIZE])[index % CHUNK_SIZE / BLOCK_SIZE])[index % BLOCK_SIZE];
+        }
+
+        /**
+         * @brief Take a block of eight default constructed nodes.
+         * @return Index of the first node of the block.
+         */
+        NodeIndex allocateBlock(){
+            if(!freeBlocks.empty()){
+                NodeIndex first = freeBlocks.back();
+                freeBlocks.pop_back();
+                return first;
+            }
+            if(used % CHUNK_SIZE == 0){
+                chunks.push_back(std::make_shared<Chunk>());
+            }
+            ownChunk(used / CHUNK_SIZE)[used % CHUNK_SIZE / BLOCK_SIZE] = std::make_shared<Block>();
+            NodeIndex first = used;
+            used += BLOCK_SIZE;
+            return first;
+        }
+
+        /**
+         * @brief Give a block back to the arena, resetting its nodes.
+         * @param first Index returned by allocateBlock().
+         */
+        void releaseBlock(NodeIndex first){
+            for(NodeIndex i = 0; i < BLOCK_SIZE; ++i){
+                (*this)[first + i] = Node();
+            }
+            freeBlocks.push_back(first);
+        }
+
+        /**
+         * @brief Get the number of nodes currently handed out.
+         * @return Nodes in live blocks.
+         */
+        size_t size() const{
+            return used - freeBlocks.size() * BLOCK_SIZE;
+        }
+
+        /**
+         * @brief Get the number of nodes copied to unshare blocks.
+         * @return Nodes copied by this arena and the arenas it was copied from.
+         */
+        size_t copiedNodes() const{
+            return copied;
+        }
+};
+
+
+#endif
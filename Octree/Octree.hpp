@@ -6,12 +6,20 @@
 #include <iostream>
 #include <algorithm>
 #include "ContainerPosition.hpp"
+#include "NodeArena.hpp"
+#include "OverlapKernel.hpp"
 #include <tuple>
 #include <stack>
 #include <memory>
+#include <array>
+#include <cstdint>
 #include <type_traits>
 #include <regex>
-#define MAX_ITEMS 4
+#include <unordered_map>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <iterator>
 
 /**
  * @concept PointConcept
@@ -101,6 +109,7 @@ template <typename T>
 requires BoundingBoxConcept<T>
 struct BoundingBox{
     T min, max;
+    BoundingBox(){}
     BoundingBox(const T& m, const T& ma) : min(m), max(ma) {}
     /**
      * @brief Check if a point is contained within the bounding box.
@@ -121,40 +130,311 @@ struct BoundingBox{
         decltype(auto) depth = max.z - min.z;
         return width > minSize && height > minSize && depth > minSize;
     }
+    /**
+     * @brief Check if another bounding box lies strictly inside this one.
+     * @param other Bounding box to check.
+     * @return True if every corner of other is contained, otherwise false.
+     */
+    bool contains(const BoundingBox<T>& other) const {
+        return min.x < other.min.x && other.max.x < max.x &&
+               min.y < other.min.y && other.max.y < max.y &&
+               min.z < other.min.z && other.max.z < max.z;
+    }
+    /**
+     * @brief Check if two bounding boxes overlap (borders included).
+     * @param other Bounding box to test against.
+     * @return True if the boxes share at least one point, otherwise false.
+     */
+    bool intersects(const BoundingBox<T>& other) const {
+        return min.x <= other.max.x && other.min.x <= max.x &&
+               min.y <= other.max.y && other.min.y <= max.y &&
+               min.z <= other.max.z && other.min.z <= max.z;
+    }
 
 };
 
+/**
+ * @class NodeItems
+ * @brief Items of one octree node kept as structure-of-arrays.
+ *
+ * Every axis minimum and maximum lives in its own contiguous array and the
+ * payloads in a parallel one, so geometric scans never load payloads. Items
+ * are read by index or iterated as pairs of bounds and payload reference.
+ *
+ * @tparam T Type representing points in 3D space.
+ * @tparam N Payload type.
+ */
+
+template <typename T, typename N>
+class NodeItems{
+    public:
+        using Coordinate = std::decay_t<decltype(T::x)>;
+
+    private:
+        std::vector<Coordinate> minX, minY, minZ;
+        std::vector<Coordinate> maxX, maxY, maxZ;
+        std::vector<N> payloads;
+
+    public:
+        class const_iterator{
+            private:
+                const NodeItems* items;
+                size_t index;
+            public:
+                const_iterator(const NodeItems* items, size_t index) : items(items), index(index) {}
+                std::pair<BoundingBox<T>, const N&> operator*() const{
+                    return {items->box(index), items->payload(index)};
+                }
+                const_iterator& operator++(){
+                    ++index;
+                    return *this;
+                }
+                bool operator==(const const_iterator& other) const{
+                    return index == other.index;
+                }
+                bool operator!=(const const_iterator& other) const{
+                    return index != other.index;
+                }
+        };
+
+        size_t size() const{
+            return payloads.size();
+        }
+
+        bool empty() const{
+            return payloads.empty();
+        }
+
+        const_iterator begin() const{
+            return const_iterator(this, 0);
+        }
+
+        const_iterator end() const{
+            return const_iterator(this, size());
+        }
+
+        void push_back(const BoundingBox<T>& bounds, N payload){
+            minX.push_back(bounds.min.x);
+            minY.push_back(bounds.min.y);
+            minZ.push_back(bounds.min.z);
+            maxX.push_back(bounds.max.x);
+            maxY.push_back(bounds.max.y);
+            maxZ.push_back(bounds.max.z);
+            payloads.push_back(std::move(payload));
+        }
+
+        /**
+         * @brief Insert an item before the given index, shifting the following ones.
+         * @param i Index the new item gets.
+         * @param bounds Bounds of the item.
+         * @param payload Payload of the item.
+         */
+        void insert(size_t i, const BoundingBox<T>& bounds, N payload){
+            minX.insert(minX.begin() + i, bounds.min.x);
+            minY.insert(minY.begin() + i, bounds.min.y);
+            minZ.insert(minZ.begin() + i, bounds.min.z);
+            maxX.insert(maxX.begin() + i, bounds.max.x);
+            maxY.insert(maxY.begin() + i, bounds.max.y);
+            maxZ.insert(maxZ.begin() + i, bounds.max.z);
+            payloads.insert(payloads.begin() + i, std::move(payload));
+        }
+
+        /**
+         * @brief Remove an item keeping the order of the remaining ones.
+         * @param i Index of the item to remove.
+         */
+        void erase(size_t i){
+            minX.erase(minX.begin() + i);
+            minY.erase(minY.begin() + i);
+            minZ.erase(minZ.begin() + i);
+            maxX.erase(maxX.begin() + i);
+            maxY.erase(maxY.begin() + i);
+            maxZ.erase(maxZ.begin() + i);
+            payloads.erase(payloads.begin() + i);
+        }
+
+        void reserve(size_t count){
+            minX.reserve(count);
+            minY.reserve(count);
+            minZ.reserve(count);
+            maxX.reserve(count);
+            maxY.reserve(count);
+            maxZ.reserve(count);
+            payloads.reserve(count);
+        }
+
+        /**
+         * @brief Remove an item by moving the last one into its slot.
+         * @param i Index of the item to remove.
+         */
+        void eraseSwap(size_t i){
+            size_t last = size() - 1;
+            if(i != last){
+                minX[i] = minX[last];
+                minY[i] = minY[last];
+                minZ[i] = minZ[last];
+                maxX[i] = maxX[last];
+                maxY[i] = maxY[last];
+                maxZ[i] = maxZ[last];
+                payloads[i] = std::move(payloads[last]);
+            }
+            minX.pop_back();
+            minY.pop_back();
+            minZ.pop_back();
+            maxX.pop_back();
+            maxY.pop_back();
+            maxZ.pop_back();
+            payloads.pop_back();
+        }
+
+        void clear(){
+            minX.clear();
+            minY.clear();
+            minZ.clear();
+            maxX.clear();
+            maxY.clear();
+            maxZ.clear();
+            payloads.clear();
+        }
+
+        T anchor(size_t i) const{
+            return T(minX[i], minY[i], minZ[i]);
+        }
+
+        BoundingBox<T> box(size_t i) const{
+            return BoundingBox<T>(T(minX[i], minY[i], minZ[i]), T(maxX[i], maxY[i], maxZ[i]));
+        }
+
+        N& payload(size_t i){
+            return payloads[i];
+        }
+
+        const N& payload(size_t i) const{
+            return payloads[i];
+        }
+
+        /**
+         * @brief Check if an item overlaps a range (borders included).
+         * @param i Index of the item.
+         * @param range Box to test against.
+         * @return True if they share at least one point, otherwise false.
+         */
+        bool intersects(size_t i, const BoundingBox<T>& range) const{
+            return minX[i] <= range.max.x && range.min.x <= maxX[i] &&
+                   minY[i] <= range.max.y && range.min.y <= maxY[i] &&
+                   minZ[i] <= range.max.z && range.min.z <= maxZ[i];
+        }
+
+        /**
+         * @brief View items starting at an index as an overlap kernel block.
+         * @param start Index of the first item of the block.
+         * @return Pointers into the coordinate arrays.
+         */
+        OverlapBoxes overlapBoxes(size_t start) const requires std::is_same_v<Coordinate, int>{
+            return OverlapBoxes{minX.data() + start, minY.data() + start, minZ.data() + start,
+                                maxX.data() + start, maxY.data() + start, maxZ.data() + start};
+        }
+};
+
+/**
+ * @brief Interleave the low 21 bits of three coordinates into a Morton (Z-order) code.
+ * @param x X coordinate, lowest bit of every triple.
+ * @param y Y coordinate.
+ * @param z Z coordinate, highest bit of every triple.
+ * @return 63-bit Morton code.
+ */
+inline std::uint64_t mortonEncode(std::uint64_t x, std::uint64_t y, std::uint64_t z){
+    auto spread = [](std::uint64_t v){
+        v &= 0x1FFFFF;
+        v = (v | v << 32) & 0x1F00000000FFFFULL;
+        v = (v | v << 16) & 0x1F0000FF0000FFULL;
+        v = (v | v << 8) & 0x100F00F00F00F00FULL;
+        v = (v | v << 4) & 0x10C30C30C30C30C3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    };
+    return spread(x) | spread(y) << 1 | spread(z) << 2;
+}
+
+/**
+ * @brief Rule used to place the planes a node is split along.
+ */
+enum class SplitRule{
+    Midpoint,   ///< Center of the node's box.
+    Median      ///< Median item center per axis, falling back to the midpoint when a half would be too small.
+};
+
+/**
+ * @struct OctreePolicy
+ * @brief Compile-time tuning of the pointer layout octree.
+ *
+ * @tparam LeafCapacity Items a leaf holds before it is split.
+ * @tparam MinSize Children must be larger than this along every axis, otherwise the node stays a leaf.
+ * @tparam Split Rule placing the split planes.
+ */
+template<size_t LeafCapacity = 4, std::int64_t MinSize = 1, SplitRule Split = SplitRule::Midpoint>
+struct OctreePolicy{
+    static constexpr size_t leafCapacity = LeafCapacity;
+    static constexpr std::int64_t minSize = MinSize;
+    static constexpr SplitRule split = Split;
+};
+
+/// Policy for yards of 20ft and 40ft containers: few, large items per cell.
+using YardOctreePolicy = OctreePolicy<8, 4, SplitRule::Midpoint>;
+
+/// Policy for racks of small parcels clustered along shelves.
+using RackOctreePolicy = OctreePolicy<16, 1, SplitRule::Median>;
+
+/**
+ * @brief Layout policy: nodes in a NodeArena linked by indices (the default).
+ */
+struct PointerLayout{};
+
+/**
+ * @brief Layout policy: items in one array sorted by Morton code, see LinearOctree.hpp.
+ */
+struct LinearLayout{};
+
 /**
  * @class Octree
  * @brief A spatial partitioning structure that organizes points in 3D space.
  * 
  * @tparam T Type representing points in 3D space.
  * @tparam N Type associated with the objects to be stored in the octree.
+ * @tparam Layout Storage layout policy, PointerLayout or LinearLayout.
+ * @tparam Policy Node tuning, an OctreePolicy.
  */
 
-template <typename T, typename N>
+template <typename T, typename N, typename Layout = PointerLayout, typename Policy = OctreePolicy<>>
 //requires BoundingBoxConcept<T> && CanAdd<T, N>
 class Octree{
     public:
         struct Node{
-            std::vector<std::pair<ContainerPosition<T>, N>> con;
-            std::array<std::shared_ptr<Node>, 8> children;
+            NodeItems<T, N> con;
             BoundingBox<T> box;
-            std::weak_ptr<Node> parent;
-            Node(BoundingBox<T> box) : box(box) {}
+            BoundingBox<T> loose; ///< Box enlarged by the octree looseness; bounds every item of the subtree.
+            NodeIndex parent = NO_NODE;
+            NodeIndex firstChild = NO_NODE; ///< First of eight consecutive children in the arena.
+            Node(){}
+            Node(BoundingBox<T> box) : box(box), loose(box) {}
             /**
              * @brief Check if the node is a leaf node (has no children).
              * @return True if it is a leaf node, otherwise false.
              */
             bool isLeaf() const {
-               return std::all_of(children.begin(), children.end(), [](const std::shared_ptr<Node>& child) { return child == nullptr; });
+               return firstChild == NO_NODE;
             }
             /**
              * @brief Get container data stored in this node.
              * @return Vector of container positions and associated data.
              */
             std::vector<std::pair<ContainerPosition<T>, N>> getCon(){
-                return con;
+                std::vector<std::pair<ContainerPosition<T>, N>> result;
+                result.reserve(con.size());
+                for(size_t i = 0; i < con.size(); ++i){
+                    result.emplace_back(positionOf(con.box(i)), con.payload(i));
+                }
+                return result;
             }
 
         };
@@ -166,20 +446,22 @@ class Octree{
 
     class BidirectionalIterator {
         private:
-            std::stack<std::shared_ptr<Node>> forwardStack;
-            std::stack<std::shared_ptr<Node>> backupStack;
+            const NodeArena<Node>* arena;
+            std::stack<const Node*> forwardStack;
+            std::stack<const Node*> backupStack;
 
         public:
-            using value_type = std::shared_ptr<Node>;
+            using value_type = const Node*;
             using pointer = value_type*;
             using reference = value_type&;
             using difference_type = std::ptrdiff_t;
             using iterator_category = std::bidirectional_iterator_tag;
         /**
          * @brief Constructor to initialize the iterator with the root node.
+         * @param arena Arena holding the nodes of the octree.
          * @param root Pointer to the root node of the octree.
          */
-            explicit BidirectionalIterator(std::shared_ptr<Node> root) {
+            BidirectionalIterator(const NodeArena<Node>* arena, const Node* root) : arena(arena) {
                 if (root != nullptr) {
                     forwardStack.push(root);
                 }
@@ -207,9 +489,9 @@ class Octree{
                 auto currentNode = forwardStack.top();
                 forwardStack.pop();
                 backupStack.push(currentNode);
-                for (int i = 7; i >= 0; --i) {
-                    if (currentNode->children[i]) {
-                        forwardStack.push(currentNode->children[i]);
+                if (!currentNode->isLeaf()) {
+                    for (int i = 7; i >= 0; --i) {
+                        forwardStack.push(&(*arena)[currentNode->firstChild + i]);
                     }
                 }
                 return *this; 
@@ -249,9 +531,160 @@ class Octree{
                 return !backupStack.empty();
             }
     };
+
+    /**
+     * @class ItemIterator
+     * @brief Forward iterator over the stored items, depth first.
+     *
+     * The path from the root is kept in a fixed array of NodeIndex frames, so
+     * stepping never allocates or touches reference counts. Dereferencing gives
+     * the item's bounds and a reference to its payload. Changing the octree
+     * invalidates the iterator.
+     */
+
+    class ItemIterator {
+        public:
+            /// Deepest node path the iterator can follow; integer bounds never split deeper.
+            static constexpr size_t MAX_DEPTH = 64;
+
+        private:
+            struct Frame{
+                NodeIndex node;
+                std::uint8_t child;
+            };
+
+            const NodeArena<Node>* arena = nullptr;
+            std::array<Frame, MAX_DEPTH> path;
+            size_t depth = 0;
+            size_t slot = 0;
+
+            // Moves to the first item at or after the current slot, descending into children when a node runs out.
+            void settle(){
+                while(depth > 0){
+                    Frame& top = path[depth - 1];
+                    const Node& node = (*arena)[top.node];
+                    if(slot < node.con.size()){
+                        return;
+                    }
+                    if(!node.isLeaf() && top.child < 8){
+                        if(depth == MAX_DEPTH){
+                            throw std::length_error("Octree is deeper than the item iterator supports");
+                        }
+                        path[depth++] = Frame{node.firstChild + top.child++, 0};
+                        slot = 0;
+                        continue;
+                    }
+                    --depth;
+                    // The parent's own items were visited before its children.
+                    slot = std::numeric_limits<size_t>::max();
+                }
+            }
+
+        public:
+            using value_type = std::pair<BoundingBox<T>, const N&>;
+            using reference = value_type;
+            using difference_type = std::ptrdiff_t;
+            using iterator_category = std::forward_iterator_tag;
+
+            ItemIterator(){}
+
+        /**
+         * @brief Create an iterator positioned at the first item of a subtree.
+         * @param arena Arena holding the nodes of the octree.
+         * @param root Index of the subtree root, or NO_NODE for the end iterator.
+         */
+            ItemIterator(const NodeArena<Node>* arena, NodeIndex root) : arena(arena) {
+                if(root != NO_NODE){
+                    path[depth++] = Frame{root, 0};
+                    settle();
+                }
+            }
+
+            reference operator*() const{
+                const Node& node = (*arena)[path[depth - 1].node];
+                return {node.con.box(slot), node.con.payload(slot)};
+            }
+
+            ItemIterator& operator++(){
+                ++slot;
+                settle();
+                return *this;
+            }
+
+            ItemIterator operator++(int){
+                ItemIterator previous = *this;
+                ++(*this);
+                return previous;
+            }
+
+            bool operator==(const ItemIterator& other) const{
+                if(depth == 0 || other.depth == 0){
+                    return depth == other.depth;
+                }
+                return path[depth - 1].node == other.path[other.depth - 1].node && slot == other.slot;
+            }
+
+            bool operator!=(const ItemIterator& other) const{
+                return !(*this == other);
+            }
+    };
+
+    /**
+     * @class ItemRange
+     * @brief Range of all stored items for range-for loops and algorithms.
+     */
+
+    class ItemRange {
+        private:
+            const NodeArena<Node>* arena;
+            NodeIndex root;
+        public:
+            ItemRange(const NodeArena<Node>* arena, NodeIndex root) : arena(arena), root(root) {}
+
+            ItemIterator begin() const{
+                return ItemIterator(arena, root);
+            }
+
+            ItemIterator end() const{
+                return ItemIterator(arena, NO_NODE);
+            }
+    };
     private:
-        std::shared_ptr<Node> root;
-        decltype(T::x) MIN_SIZE = 1;
+        struct AnchorHash{
+            size_t operator()(const T& p) const{
+                using Coordinate = std::decay_t<decltype(p.x)>;
+                size_t h = std::hash<Coordinate>{}(p.x);
+                h = h * 1000003u ^ std::hash<Coordinate>{}(p.y);
+                h = h * 1000003u ^ std::hash<Coordinate>{}(p.z);
+                return h;
+            }
+        };
+        /// Node and index in its con vector holding the item with a given anchor.
+        struct Location{
+            NodeIndex node;
+            size_t slot;
+        };
+
+        NodeArena<Node> nodes;
+        NodeIndex root = NO_NODE;
+        using AnchorMap = std::unordered_map<T, Location, AnchorHash>;
+        static constexpr size_t ANCHOR_SHARDS = 64;
+        using AnchorShards = std::array<std::shared_ptr<AnchorMap>, ANCHOR_SHARDS>;
+
+        static AnchorShards emptyAnchors(){
+            AnchorShards shards;
+            for(auto& shard : shards){
+                shard = std::make_shared<AnchorMap>();
+            }
+            return shards;
+        }
+
+        // Anchor index split into shards that copies of the octree share until one of them writes.
+        AnchorShards anchors = emptyAnchors();
+        using Coordinate = std::decay_t<decltype(T::x)>;
+        static constexpr size_t LEAF_CAPACITY = Policy::leafCapacity;
+        static constexpr Coordinate MIN_SIZE = static_cast<Coordinate>(Policy::minSize);
+        double looseness = 1.0;
     public:
 
 
@@ -262,36 +695,61 @@ class Octree{
         using iterator = BidirectionalIterator;
         using const_iterator = BidirectionalIterator;
         using difference_type = std::ptrdiff_t;
+        /// Placed item: the container's bounds and its payload.
+        using Item = std::pair<BoundingBox<T>, N>;
 
 
         Octree(){}
-        Octree(BoundingBox<T> bbox) {
-            root = std::make_shared<Node>(bbox);
+    /**
+     * @brief Create an empty octree.
+     *
+     * With a looseness above 1 every child accepts items that fit into its box
+     * enlarged by that factor (a loose octree), so containers crossing a
+     * midplane sink into children instead of piling up in their parents.
+     *
+     * @param bbox Bounding box covered by the octree.
+     * @param looseness Ratio between a child's loose and tight size, at least 1.
+     * @throws std::invalid_argument If the looseness is below 1.
+     */
+        Octree(BoundingBox<T> bbox, double looseness = 1.0) : looseness(looseness) {
+            if(looseness < 1.0){
+                throw std::invalid_argument("Octree looseness must be at least 1");
+            }
+            root = nodes.allocateBlock();
+            nodes[root] = Node(bbox);
         }
 
 
         BidirectionalIterator begin() {
-            return BidirectionalIterator(root);
+            return BidirectionalIterator(&nodes, getRoot());
         }
 
         BidirectionalIterator end() {
-            return BidirectionalIterator(nullptr);
+            return BidirectionalIterator(&nodes, nullptr);
         }
 
         BidirectionalIterator cbegin() const {
-            return BidirectionalIterator(root);
+            return BidirectionalIterator(&nodes, getRoot());
         }
 
         BidirectionalIterator cend() const {
-            return BidirectionalIterator(nullptr);
+            return BidirectionalIterator(&nodes, nullptr);
+        }
+
+    /**
+     * @brief Get all stored items without allocating.
+     * @return Range yielding (bounds, payload) pairs, valid until the octree changes.
+     */
+        ItemRange items() const{
+            return ItemRange(&nodes, root);
         }
 
     /**
      * @brief Get the root node of the octree.
-     * @return A shared pointer to the root node.
+     * @return A pointer to the root node, or nullptr for a default constructed octree.
      */
-        std::shared_ptr<Node>  getRoot(){
-            return root;
+        const Node* getRoot() const{
+            return root == NO_NODE ? nullptr : &nodes[root];
         }
 
     /**
@@ -306,31 +764,60 @@ class Octree{
      * @return True if a collision is detected, otherwise false.
      */
         bool checkCollisions(N container, const T& p) const {
-        ContainerPosition<T> pos = calculateContainerPosition(p.x, p.y, p.z, container); 
-        BidirectionalIterator it = cbegin();
-        if(!root->box.contains(pos.LLDown) || !root->box.contains(pos.LLUp) ||
-        !root->box.contains(pos.LRUp) ||  !root->box.contains(pos.LRDown) ||
-        !root->box.contains(pos.RLDown) || !root->box.contains(pos.RLUp) ||
-        !root->box.contains(pos.RRUp) || !root->box.contains(pos.RRDown)){
-            return true;
-        }
-        while (it.hasNext()) {
-            auto currentNode = *it;
-            if (checkCollision(container, pos, currentNode->con)) {
+            BoundingBox<T> bounds = calculateBounds(p.x, p.y, p.z, container);
+            if(!nodes[root].box.contains(bounds)){
                 return true;
             }
-            ++it;
+            return checkCollision(bounds);
         }
-        return false;
-    }
 
     /**
      * @brief Clone the octree.
-     * @return A new cloned octree.
+     *
+     * The clone shares node chunks and anchor shards with this octree; either
+     * side copies a block of eight sibling nodes or a shard the first time it
+     * modifies it, so cloning costs O(chunks) and later edits pay only for the
+     * blocks on the paths they touch.
+     *
+     * @return A new cloned octree holding the same items.
      */
         Octree Clone() const{
-            auto clone = Octree(this->root->box);
-            return clone;
+            return *this;
+        }
+
+    /**
+     * @brief Replace the contents of the octree with already placed items.
+     *
+     * Items are sorted by the Morton code of their centers and the tree is
+     * built top-down: a node holding more than the leaf capacity is split once
+     * and its items are partitioned between the children in a single pass.
+     * Positions are trusted, so no collision or bounds checks are made.
+     *
+     * @param items Bounds and payloads of the items; bounds must lie inside the octree.
+     * @throws std::invalid_argument If the octree was default constructed.
+     */
+        void bulkLoad(std::vector<Item> items){
+            if(root == NO_NODE){
+                throw std::invalid_argument("Octree has no bounds");
+            }
+            BoundingBox<T> bounds = nodes[root].box;
+            nodes = NodeArena<Node>();
+            anchors = emptyAnchors();
+            root = nodes.allocateBlock();
+            nodes[root] = Node(bounds);
+
+            std::vector<std::pair<std::uint64_t, size_t>> order(items.size());
+            for(size_t i = 0; i < items.size(); ++i){
+                order[i] = std::make_pair(mortonCode(bounds, items[i].first), i);
+            }
+            std::sort(order.begin(), order.end());
+            std::vector<Item> sorted;
+            sorted.reserve(items.size());
+            for(const auto& entry : order){
+                sorted.push_back(std::move(items[entry.second]));
+            }
+            std::vector<Item> scratch(sorted.size());
+            build(root, sorted, scratch, 0, sorted.size());
         }
 
     /**
@@ -339,14 +826,20 @@ class Octree{
      * @return True if the removal was successful, otherwise false.
      */
         bool remove(const T& p){
-            bool collision = false;
-            std::shared_ptr<Node> copy = nullptr;
-            removeR(p, root, collision, copy);
-            if(collision == false){
+            AnchorMap& shard = ownAnchors(p);
+            auto it = shard.find(p);
+            if(it == shard.end()){
                 return false;
             }
-            collision = false;
-            Update(copy);
+            Location location = it->second;
+            shard.erase(it);
+            auto& con = nodes[location.node].con;
+            con.eraseSwap(location.slot);
+            if(location.slot < con.size()){
+                T moved = con.anchor(location.slot);
+                ownAnchors(moved)[moved].slot = location.slot;
+            }
+            Update(location.node);
             return true;
         }
 
@@ -357,13 +850,13 @@ class Octree{
      * @throws std::invalid_argument if the item is not found.
      */
         std::pair<ContainerPosition<T>, N> search(const T& p) const{
-            std::pair<ContainerPosition<T>, N> copyCache;
-            bool found = false;
-            searchR(p, root, copyCache, found);
-            if(found == false){
+            const AnchorMap& shard = *anchors[AnchorHash{}(p) % ANCHOR_SHARDS];
+            auto it = shard.find(p);
+            if(it == shard.end()){
                 throw std::invalid_argument("Item not found");
             }
-            return copyCache;
+            const auto& con = nodes[it->second.node].con;
+            return std::make_pair(positionOf(con.box(it->second.slot)), con.payload(it->second.slot));
         }
 
     /**
@@ -376,6 +869,58 @@ class Octree{
             return copyCache;
         }
 
+    /**
+     * @brief Visit every stored item whose position overlaps a range.
+     *
+     * Subtrees whose bounding box cannot intersect the range are skipped and items
+     * are handed to the visitor by reference, so nothing is copied. The visitor is
+     * called as visit(const BoundingBox<T>&, const N&) with the item's bounds and
+     * returns false to stop the traversal.
+     *
+     * @param range Inclusive box to query.
+     * @param visit Callable invoked for each overlapping item.
+     * @return False if the visitor stopped the traversal early, otherwise true.
+     */
+        template<typename Visitor>
+        bool queryRange(const BoundingBox<T>& range, Visitor&& visit) const{
+            if(root == NO_NODE){
+                return true;
+            }
+            return queryRange(nodes[root], range, visit);
+        }
+
+    /**
+     * @brief Get the number of nodes allocated from the node arena.
+     * @return Count of live nodes, including unused siblings of the root block.
+     */
+        size_t nodeCount() const{
+            return nodes.size();
+        }
+
+    /**
+     * @brief Get the number of nodes copied so far because they were shared with a clone.
+     * @return Copied nodes, counted across clones.
+     */
+        size_t copiedNodes() const{
+            return nodes.copiedNodes();
+        }
+
+    /**
+     * @brief Get the looseness factor the octree was created with.
+     * @return Ratio between a child's loose and tight size.
+     */
+        double getLooseness() const{
+            return looseness;
+        }
+
+    /**
+     * @brief Get the bounding box covered by the octree.
+     * @return The bounding box of the root node.
+     */
+        const BoundingBox<T>& getBounds() const{
+            return nodes[root].box;
+        }
+
     /**
      * @brief Search and insert a container at a specified point.
      * @param container The container to be inserted.
@@ -383,15 +928,7 @@ class Octree{
      * @return True if the insertion was successful, otherwise false.
      */
         bool SearchInsert(N container, const T& p) const{
-            ContainerPosition<T> pos = calculateContainerPosition(p.x, p.y, p.z, container);
-            bool collision = false;
-            std::shared_ptr<Node> copyCache = nullptr;
-            std::vector<std::pair<ContainerPosition<T>, N>> copy(0);
-            SearchInsert(container, pos, root, copyCache, copy, collision);
-            if(copyCache == nullptr){
-                return false;
-            }
-            return true;
+            return SearchPush(calculateBounds(p.x, p.y, p.z, container)) != NO_NODE;
         }
 
     /**
@@ -490,6 +1027,28 @@ class Octree{
             return std::max({position.LLDown.z, position.LLUp.z, position.LRDown.z, position.LRUp.z, position.RRDown.z, position.RRUp.z, position.RLDown.z, position.RLUp.z});
         }
 
+    /**
+     * @brief Get the axis-aligned bounds of a container position.
+     * @param position A constant reference to a `ContainerPosition<T>` object.
+     * @return Bounding box spanning the minimum and maximum corners.
+     */
+        static BoundingBox<T> boundsOf(const ContainerPosition<T>& position){
+            return BoundingBox<T>(T(getMinX(position), getMinY(position), getMinZ(position)),
+                                  T(getMaxX(position), getMaxY(position), getMaxZ(position)));
+        }
+
+    /**
+     * @brief Rebuild the eight corners of an axis-aligned box.
+     * @param bounds Bounding box of a container.
+     * @return Container position whose LLDown corner is bounds.min.
+     */
+        static ContainerPosition<T> positionOf(const BoundingBox<T>& bounds){
+            const T& a = bounds.min;
+            const T& b = bounds.max;
+            return ContainerPosition<T>(a, T(a.x, a.y, b.z), T(b.x, a.y, a.z), T(b.x, a.y, b.z),
+                                        T(b.x, b.y, a.z), b, T(a.x, b.y, a.z), T(a.x, b.y, b.z));
+        }
+
     /**
      * @brief Push a container into the octree at a specified point.
      * 
@@ -501,9 +1060,26 @@ class Octree{
      * @return True if the push operation is successful, otherwise false.
      */
         bool push(N container, T p){
-            ContainerPosition<T> position = calculateContainerPosition(p.x, p.y, p.z, container);
-            std::shared_ptr<Node> target = SearchPush(container, position);
-            return insert(container, position, target);
+            BoundingBox<T> bounds = calculateBounds(p.x, p.y, p.z, container);
+            NodeIndex target = SearchPush(bounds);
+            return insert(container, bounds, target);
+        }
+
+    /**
+     * @brief Put a container back where it is known to fit, such as the place it was just removed from.
+     *
+     * Unlike push() no collision check is made, the caller guarantees the place is free.
+     *
+     * @param container The container to be put back.
+     * @param p The point (coordinates) where the container should be inserted.
+     * @throws std::logic_error If the container does not lie inside the octree.
+     */
+        void restore(N container, T p){
+            BoundingBox<T> bounds = calculateBounds(p.x, p.y, p.z, container);
+            if(root == NO_NODE || !nodes[root].box.contains(bounds)){
+                throw std::logic_error("Restored item lies outside the octree");
+            }
+            insert(container, bounds, descend(bounds));
         }
     /**
      * @brief Check if a point is within a specified container position.
@@ -590,309 +1166,386 @@ class Octree{
         }
 
 
+    /**
+     * @brief Calculate the bounds of a container placed at the given coordinates.
+     * @param x X coordinate.
+     * @param y Y coordinate.
+     * @param z Z coordinate.
+     * @param container The container for which the bounds are calculated.
+     * @return Box from (x, y, z) to (x + length, y + width, z + height).
+     */
+        static BoundingBox<T> calculateBounds(decltype(T::x) x, decltype(T::x) y, decltype(T::x) z, N container){
+            static_assert(CanAdd<T, N>, "Концепции неудовлетворены");
+            using Handler = ContainerHandler<std::decay_t<N>>;
+            return BoundingBox<T>(T(x, y, z), T(x + Handler::getLength(container), y + Handler::getWidth(container), z + Handler::getHeight(container)));
+        }
+
+
         private:
 
-        bool insert(N container, ContainerPosition<T>& position, std::shared_ptr<Node> target){
-            if(target == nullptr){
+        bool insert(N container, const BoundingBox<T>& bounds, NodeIndex target){
+            if(target == NO_NODE){
                 return false;
             }
-            target->con.push_back(std::make_pair(position, container));
-            if (target->con.empty() == false && target->con.size() > MAX_ITEMS && target->isLeaf()){
-                std::cout << "Split\n";
-                split(target);
+            place(target, bounds, std::move(container));
+            const Node& node = view(target);
+            if (node.con.size() > LEAF_CAPACITY && node.isLeaf()){
+                split(target, splitPoint(node.box, node.con.size(), [&](size_t i){
+                    return node.con.box(i);
+                }));
             }
             return true;
         }
 
-        void split(std::shared_ptr<Node> node) {
-            if (!node){
-                return;
-            }
-            if (node->children[0] != nullptr){
-                return;
+        // Midpoint of the box, or with the median rule a plane through the median item
+        // on every axis: its center or the face right behind it, whichever cuts fewer
+        // items (cut items stay in the parent). The midpoint is kept when it cuts fewer
+        // still or a half would not be larger than the minimum size.
+        template<typename BoxAt>
+        static T splitPoint(const BoundingBox<T>& box, size_t count, BoxAt boxAt){
+            T mid((box.min.x + box.max.x) / 2, (box.min.y + box.max.y) / 2, (box.min.z + box.max.z) / 2);
+            if constexpr (Policy::split == SplitRule::Median){
+                if(count == 0){
+                    return mid;
+                }
+                std::vector<std::pair<Coordinate, Coordinate>> centers(count);
+                auto median = [&](auto axis, Coordinate lo, Coordinate hi, Coordinate fallback){
+                    for(size_t i = 0; i < count; ++i){
+                        BoundingBox<T> item = boxAt(i);
+                        centers[i] = std::make_pair((axis(item.min) + axis(item.max)) / 2, axis(item.max));
+                    }
+                    std::nth_element(centers.begin(), centers.begin() + count / 2, centers.end());
+                    auto cuts = [&](Coordinate plane){
+                        size_t cut = 0;
+                        for(size_t i = 0; i < count; ++i){
+                            BoundingBox<T> item = boxAt(i);
+                            cut += axis(item.min) <= plane && plane <= axis(item.max);
+                        }
+                        return cut;
+                    };
+                    Coordinate best = fallback;
+                    size_t bestCuts = cuts(fallback);
+                    for(Coordinate plane : {centers[count / 2].second + 1, centers[count / 2].first}){
+                        size_t planeCuts = cuts(plane);
+                        if(plane - lo > MIN_SIZE && hi - plane > MIN_SIZE && planeCuts <= bestCuts){
+                            best = plane;
+                            bestCuts = planeCuts;
+                        }
+                    }
+                    return best;
+                };
+                mid.x = median([](const T& p){ return p.x; }, box.min.x, box.max.x, mid.x);
+                mid.y = median([](const T& p){ return p.y; }, box.min.y, box.max.y, mid.y);
+                mid.z = median([](const T& p){ return p.z; }, box.min.z, box.max.z, mid.z);
             }
+            return mid;
+        }
 
-            decltype(auto) min = node->box.min;
-            decltype(auto) max = node->box.max;
-
-            decltype(auto) midX = (min.x + max.x) / 2;
-            decltype(auto) midY = (min.y + max.y) / 2;
-            decltype(auto) midZ = (min.z + max.z) / 2;
-
-            BoundingBox<T> box0 = BoundingBox<T>(min, T(midX, midY, midZ));
-            BoundingBox<T> box1 = BoundingBox<T>(T(midX, min.y, min.z), T(max.x, midY, midZ));
-            BoundingBox<T> box2 = BoundingBox<T>(T(min.x, midY, min.z), T(midX, max.y, midZ));
-            BoundingBox<T> box3 = BoundingBox<T>(T(midX, midY, min.z), T(max.x, max.y, midZ));
-            BoundingBox<T> box4 = BoundingBox<T>(T(min.x, min.y, midZ), T(midX, midY, max.z));
-            BoundingBox<T> box5 = BoundingBox<T>(T(midX, min.y, midZ), T(max.x, midY, max.z));
-            BoundingBox<T> box6 = BoundingBox<T>(T(min.x, midY, midZ), T(midX, max.y, max.z));
-            BoundingBox<T> box7 = BoundingBox<T>(T(midX, midY, midZ), max);
-
-            if(!box0.isValid(MIN_SIZE) || !box1.isValid(MIN_SIZE)
-            || !box2.isValid(MIN_SIZE) || !box3.isValid(MIN_SIZE)
-            ||!box4.isValid(MIN_SIZE) || !box5.isValid(MIN_SIZE)
-            ||!box6.isValid(MIN_SIZE) || !box7.isValid(MIN_SIZE)){
+        void split(NodeIndex index, const T& mid) {
+            if (index == NO_NODE || !view(index).isLeaf()){
                 return;
             }
 
-            node->children[0] = std::make_shared<Node>(box0); // 0: мин
-            node->children[1] = std::make_shared<Node>(box1); // 1: x+
-            node->children[2] = std::make_shared<Node>(box2); // 2: y+
-            node->children[3] = std::make_shared<Node>(box3); // 3: xy+
-            node->children[4] = std::make_shared<Node>(box4); // 4: z+
-            node->children[5] = std::make_shared<Node>(box5); // 5: x+z+
-            node->children[6] = std::make_shared<Node>(box6); // 6: y+z+
-            node->children[7] = std::make_shared<Node>(box7); // 7: xyz+
-            node->children[0]->parent = node;
-            node->children[1]->parent = node;
-            node->children[2]->parent = node;
-            node->children[3]->parent = node;
-            node->children[4]->parent = node;
-            node->children[5]->parent = node;
-            node->children[6]->parent = node;
-            node->children[7]->parent = node;
-            
-            for (auto it = node->con.begin(); it != node->con.end(); ) {
-                bool moved = false;
-
-                for (int i = 0; i < 8; ++i) {
-                    if (node->children[i]->box.contains(it->first.LLDown) && 
-                        node->children[i]->box.contains(it->first.LLUp) &&
-                        node->children[i]->box.contains(it->first.LRDown) &&
-                        node->children[i]->box.contains(it->first.LRUp) &&
-                        node->children[i]->box.contains(it->first.RLDown) &&
-                        node->children[i]->box.contains(it->first.RLUp) &&
-                        node->children[i]->box.contains(it->first.RRDown) &&
-                        node->children[i]->box.contains(it->first.RRUp)) {
-                        node->children[i]->con.push_back(*it);
-                        moved = true;
-                        break;
-                    }
+            decltype(auto) min = view(index).box.min;
+            decltype(auto) max = view(index).box.max;
+
+            decltype(auto) midX = mid.x;
+            decltype(auto) midY = mid.y;
+            decltype(auto) midZ = mid.z;
+
+            std::array<BoundingBox<T>, 8> boxes = {
+                BoundingBox<T>(min, T(midX, midY, midZ)),                   // 0: мин
+                BoundingBox<T>(T(midX, min.y, min.z), T(max.x, midY, midZ)), // 1: x+
+                BoundingBox<T>(T(min.x, midY, min.z), T(midX, max.y, midZ)), // 2: y+
+                BoundingBox<T>(T(midX, midY, min.z), T(max.x, max.y, midZ)), // 3: xy+
+                BoundingBox<T>(T(min.x, min.y, midZ), T(midX, midY, max.z)), // 4: z+
+                BoundingBox<T>(T(midX, min.y, midZ), T(max.x, midY, max.z)), // 5: x+z+
+                BoundingBox<T>(T(min.x, midY, midZ), T(midX, max.y, max.z)), // 6: y+z+
+                BoundingBox<T>(T(midX, midY, midZ), max)                     // 7: xyz+
+            };
+
+            for (const auto& box : boxes) {
+                if (!box.isValid(MIN_SIZE)) {
+                    return;
                 }
+            }
 
-                if (moved) {
-                    it = node->con.erase(it);
-                } else {
-                    ++it;
-                }
+            NodeIndex first = nodes.allocateBlock();
+            for (int i = 0; i < 8; ++i) {
+                nodes[first + i].box = boxes[i];
+                nodes[first + i].loose = loosen(boxes[i]);
+                nodes[first + i].parent = index;
+            }
+            nodes[index].firstChild = first;
+
+            NodeItems<T, N> items = std::move(nodes[index].con);
+            nodes[index].con.clear();
+            for (size_t item = 0; item < items.size(); ++item) {
+                BoundingBox<T> bounds = items.box(item);
+                NodeIndex target = childFor(index, bounds);
+                place(target == NO_NODE ? index : target, bounds, std::move(items.payload(item)));
             }
         }
 
 
+        // 63-bit Morton code of the item's center, scaled to 21 bits per axis of the root box.
+        static std::uint64_t mortonCode(const BoundingBox<T>& space, const BoundingBox<T>& item){
+            auto scale = [](double center, double min, double max) -> std::uint64_t {
+                double t = max > min ? (center - min) / (max - min) : 0.0;
+                return static_cast<std::uint64_t>(std::clamp(t, 0.0, 1.0) * 0x1FFFFF);
+            };
+            std::uint64_t x = scale((item.min.x + item.max.x) / 2.0, space.min.x, space.max.x);
+            std::uint64_t y = scale((item.min.y + item.max.y) / 2.0, space.min.y, space.max.y);
+            std::uint64_t z = scale((item.min.z + item.max.z) / 2.0, space.min.z, space.max.z);
+            return mortonEncode(x, y, z);
+        }
+
 
-        void  searchUnderOct(std::shared_ptr<Node> node, std::vector<std::pair<ContainerPosition<T>, N>>& vec) const{
-            if(node == nullptr){
+        // Places items[begin, end) under the node; scratch is a buffer of the same size as items.
+        void build(NodeIndex index, std::vector<Item>& items, std::vector<Item>& scratch, size_t begin, size_t end){
+            if(end - begin > LEAF_CAPACITY){
+                split(index, splitPoint(nodes[index].box, end - begin, [&](size_t i){
+                    return items[begin + i].first;
+                }));
+            }
+            if(nodes[index].isLeaf()){
+                for(size_t i = begin; i < end; ++i){
+                    place(index, items[i].first, std::move(items[i].second));
+                }
                 return;
             }
-            if(!node->con.empty()){
-                vec.insert(vec.end(), node->con.begin(), node->con.end());
+            // Bucket 8 keeps the items that fit no child; a stable counting pass keeps Morton order.
+            std::array<size_t, 10> offsets{};
+            std::vector<std::uint8_t> buckets(end - begin);
+            for(size_t i = begin; i < end; ++i){
+                NodeIndex child = childFor(index, items[i].first);
+                buckets[i - begin] = static_cast<std::uint8_t>(child == NO_NODE ? 8 : child - nodes[index].firstChild);
+                ++offsets[buckets[i - begin] + 1];
             }
-            for(int i = 0; i < 8; ++i){
-                searchUnderOct(node->children[i], vec);
+            for(size_t b = 1; b < offsets.size(); ++b){
+                offsets[b] += offsets[b - 1];
             }
-        }
-
-
-        void searchDepth(std::shared_ptr<Node> node, std::vector<std::pair<ContainerPosition<T>, N>>& copyCache) const{
-            if(node == nullptr){
-                return;
+            std::array<size_t, 9> next;
+            std::copy(offsets.begin(), offsets.end() - 1, next.begin());
+            for(size_t i = begin; i < end; ++i){
+                scratch[begin + next[buckets[i - begin]]++] = std::move(items[i]);
             }
-            if(!node->con.empty()){
-                (copyCache).insert((copyCache).end(), node->con.begin(), node->con.end());
+            std::move(scratch.begin() + begin, scratch.begin() + end, items.begin() + begin);
+            for(size_t i = begin + offsets[8]; i < begin + offsets[9]; ++i){
+                place(index, items[i].first, std::move(items[i].second));
             }
-            for(int i = 0; i < 8; ++i){
-                searchDepth(node->children[i], copyCache);
+            NodeIndex first = nodes[index].firstChild;
+            for(NodeIndex b = 0; b < 8; ++b){
+                build(first + b, items, scratch, begin + offsets[b], begin + offsets[b + 1]);
             }
         }
 
 
-        bool SearchInsert(N container, ContainerPosition<T> pos, std::shared_ptr<Node> node, std::shared_ptr<Node>& copyCache, std::vector<std::pair<ContainerPosition<T>, N>>& copy, bool& collision) const{
-            if(node == nullptr){
-                return false;
-            }
-             if (!node->box.contains(pos.LLDown) || !node->box.contains(pos.LLUp) ||
-                !node->box.contains(pos.LRDown) || !node->box.contains(pos.LRUp) ||
-                !node->box.contains(pos.RLDown) || !node->box.contains(pos.RLUp) ||
-                !node->box.contains(pos.RRDown) || !node->box.contains(pos.RRUp)) {
-                return false;
-            }
-            if(!node->con.empty()){
-                (copy).insert((copy).end(), node->con.begin(), node->con.end());
-            }
-            if (node->isLeaf() == false && collision == false && copyCache == nullptr) {
-                for (size_t i = 0; i < 8; ++i) {
-                     SearchInsert(container, pos, node->children[i], copyCache, copy, collision);
-                }
-            }
-            if(collision == false && copyCache == nullptr){
-                
-                searchUnderOct(node, copy);
-                
-                if(!checkCollision(container, pos, copy)){
-                    copyCache = node;
-                    return true;
-                }else{
-                    collision = true;
-                    return false;
-                }
-            }else if(collision == false && copyCache != nullptr){
-                return true;
+        BoundingBox<T> loosen(const BoundingBox<T>& box) const{
+            using Coordinate = std::decay_t<decltype(T::x)>;
+            double grow = (looseness - 1.0) / 2.0;
+            Coordinate dx = static_cast<Coordinate>((box.max.x - box.min.x) * grow);
+            Coordinate dy = static_cast<Coordinate>((box.max.y - box.min.y) * grow);
+            Coordinate dz = static_cast<Coordinate>((box.max.z - box.min.z) * grow);
+            return BoundingBox<T>(T(box.min.x - dx, box.min.y - dy, box.min.z - dz), T(box.max.x + dx, box.max.y + dy, box.max.z + dz));
+        }
+
+
+        // The child holding the item's center is the only candidate; with looseness 1
+        // this is exactly the child whose box contains the whole item, if any.
+        NodeIndex childFor(NodeIndex index, const BoundingBox<T>& bounds) const{
+            const Node& node = nodes[index];
+            if(node.isLeaf()){
+                return NO_NODE;
             }
-            return false;
+            // The first child spans from the node's minimum to the split point.
+            const T& split = nodes[node.firstChild].box.max;
+            decltype(auto) midX = split.x;
+            decltype(auto) midY = split.y;
+            decltype(auto) midZ = split.z;
+            NodeIndex octant = ((bounds.min.x + bounds.max.x) / 2 >= midX ? 1 : 0)
+                             | ((bounds.min.y + bounds.max.y) / 2 >= midY ? 2 : 0)
+                             | ((bounds.min.z + bounds.max.z) / 2 >= midZ ? 4 : 0);
+            NodeIndex child = node.firstChild + octant;
+            return nodes[child].loose.contains(bounds) ? child : NO_NODE;
         }
 
 
+        // Read-only access that never unshares a chunk.
+        const Node& view(NodeIndex index) const{
+            return nodes[index];
+        }
 
-        std::shared_ptr<Node> SearchPush(N container, ContainerPosition<T> pos) const{
-            bool collision = false;
-            std::shared_ptr<Node> copyCache = nullptr;
-            std::vector<std::pair<ContainerPosition<T>, N>> copy(0);
-            SearchInsert(container, pos, root, copyCache, copy, collision);
-            return copyCache;
+
+        AnchorMap& ownAnchors(const T& p){
+            auto& shard = anchors[AnchorHash{}(p) % ANCHOR_SHARDS];
+            if(shard.use_count() > 1){
+                shard = std::make_shared<AnchorMap>(*shard);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return *shard;
         }
 
 
-            void searchR(T id, std::shared_ptr<Node> node, std::pair<ContainerPosition<T>, N>& copyCache, bool& flag)const{
-                if(node == nullptr){
-                    return;
-                }
-                if(!node->box.contains(id)){
-                    return;
-                }
-                if(node->con.empty() == false){
-                    for(auto& i : node->con){
-                        if(i.first.LLDown.x != -1  && (i.first.LLDown) == id){
-                            flag = true;
-                            copyCache = std::make_pair(i.first, i.second);
-                            return;
-                        }
-                    }
+        void place(NodeIndex index, const BoundingBox<T>& bounds, N payload){
+            auto& con = nodes[index].con;
+            ownAnchors(bounds.min)[bounds.min] = Location{index, con.size()};
+            con.push_back(bounds, std::move(payload));
+        }
+
+
+
+        template<typename Visitor>
+        bool queryRange(const Node& node, const BoundingBox<T>& range, Visitor& visit) const{
+            if(!node.loose.intersects(range)){
+                return true;
+            }
+            for(size_t i = 0; i < node.con.size(); ++i){
+                if(node.con.intersects(i, range) && !visit(node.con.box(i), node.con.payload(i))){
+                    return false;
                 }
-                if(node->isLeaf() == false){
-                    for(int i = 0; i < 8; ++i){
-                        searchR(id, node->children[i], copyCache, flag);
+            }
+            if(!node.isLeaf()){
+                for(NodeIndex i = 0; i < 8; ++i){
+                    if(!queryRange(nodes[node.firstChild + i], range, visit)){
+                        return false;
                     }
                 }
             }
+            return true;
+        }
 
 
-            void removeR(T id, std::shared_ptr<Node> node, bool& collision, std::shared_ptr<Node>& copyCache){
-                if(node == nullptr){
-                    return;
-                }
-                if(collision == true || node == nullptr){
-                    return;
-                }
-                if(!node->box.contains(id)){
-                    return;
-                }
-                if(node->con.empty() == false){
-                    for(auto& i : node->con){
-                        if(i.first.LLDown.x != -1  && i.first.LLDown == id){
-                            /*if(i.second != nullptr)*/{
-                                node->con.erase(std::remove(node->con.begin(), node->con.end(), i), node->con.end());
-                            }
-                            collision = true;
-                            copyCache = node;
-                            return;
-                        }
-                    }
-                }
-                if(node->isLeaf() == false){
-                    for(int i = 0; i < 8; ++i){
-                        removeR(id, node->children[i], collision, copyCache);
-                    }
+        void searchDepth(NodeIndex index, std::vector<std::pair<ContainerPosition<T>, N>>& copyCache) const{
+            if(index == NO_NODE){
+                return;
+            }
+            const Node& node = nodes[index];
+            for(size_t i = 0; i < node.con.size(); ++i){
+                copyCache.emplace_back(positionOf(node.con.box(i)), node.con.payload(i));
+            }
+            if(!node.isLeaf()){
+                for(NodeIndex i = 0; i < 8; ++i){
+                    searchDepth(node.firstChild + i, copyCache);
                 }
+            }
+        }
 
+
+        NodeIndex SearchPush(const BoundingBox<T>& bounds) const{
+            if(!nodes[root].box.contains(bounds) || checkCollision(bounds)){
+                return NO_NODE;
             }
+            return descend(bounds);
+        }
 
+        // Deepest node whose loose bounds take the box.
+        NodeIndex descend(const BoundingBox<T>& bounds) const{
+            NodeIndex index = root;
+            while(!nodes[index].isLeaf()){
+                NodeIndex next = childFor(index, bounds);
+                if(next == NO_NODE){
+                    break;
+                }
+                index = next;
+            }
+            return index;
+        }
 
-            bool checkEmptyNode(std::shared_ptr<Node> node) const{
-            if (node == nullptr) return true;
-            for (int i = 0; i < 8; ++i) {
-                if (node->children[i] != nullptr && !node->children[i]->con.empty()) {
+
+            bool checkEmptyNode(NodeIndex index) const{
+            if (index == NO_NODE || nodes[index].isLeaf()) return true;
+            for (NodeIndex i = 0; i < 8; ++i) {
+                if (!nodes[nodes[index].firstChild + i].con.empty()) {
                     return false;
                 }
             }
             return true;
         }
 
-           void mearge(std::shared_ptr<Node> node) {
-                if (node == nullptr || node->isLeaf()) return;
-                for (int i = 0; i < 8; ++i) {
-                    if (node->children[i] != nullptr && !node->children[i]->con.empty()) {
-                        node->con.insert(node->con.end(), node->children[i]->con.begin(), node->children[i]->con.end());
-                        node->children[i]->con.clear();
+           void mearge(NodeIndex index) {
+                if (index == NO_NODE || view(index).isLeaf()) return;
+                NodeIndex first = view(index).firstChild;
+                for (NodeIndex i = 0; i < 8; ++i) {
+                    if (!view(first + i).con.empty()) {
+                        auto& childCon = nodes[first + i].con;
+                        for (size_t item = 0; item < childCon.size(); ++item) {
+                            place(index, childCon.box(item), std::move(childCon.payload(item)));
+                        }
+                        childCon.clear();
                     }
                 }
-                for (int i = 0; i < 8; ++i) {
-                    mearge(node->children[i]);
+                for (NodeIndex i = 0; i < 8; ++i) {
+                    mearge(first + i);
                 }
             }
 
-            void decreaseHightTree(std::shared_ptr<Node> node) {
-                if (node == nullptr || node->isLeaf()) {
+            void decreaseHightTree(NodeIndex index) {
+                if (index == NO_NODE || view(index).isLeaf()) {
                     return;
                 }
-                for (int i = 0; i < 8; ++i) {
-                    decreaseHightTree(node->children[i]);
+                NodeIndex first = view(index).firstChild;
+                bool leaves = true;
+                for (NodeIndex i = 0; i < 8; ++i) {
+                    decreaseHightTree(first + i);
+                    leaves = leaves && view(first + i).isLeaf();
                 }
-                if (checkEmptyNode(node)) {
-                    for (int i = 0; i < 8; ++i) {
-                        if (node->children[i] != nullptr && node->children[i]->isLeaf()) { 
-                            node->children[i].reset();
-                            node->children[i] = nullptr;
-                        }
-                    }
+                // Children are allocated as one block, so they go away together.
+                if (leaves && checkEmptyNode(index)) {
+                    nodes.releaseBlock(first);
+                    nodes[index].firstChild = NO_NODE;
                 }
             }
 
 
-            void Update(std::shared_ptr<Node> node) {
-                 auto parentNode = node->parent.lock(); 
-                if(node == root && node->isLeaf() == false && node->con.empty()){
-                    mearge(node);
-                    decreaseHightTree(node);
+            void Update(NodeIndex index) {
+                NodeIndex parentNode = view(index).parent;
+                if(index == root && view(index).isLeaf() == false && view(index).con.empty()){
+                    mearge(index);
+                    decreaseHightTree(index);
                     return;
                 }
-                if(checkEmptyNode(parentNode)){
+                if(parentNode != NO_NODE && checkEmptyNode(parentNode)){
                     mearge(parentNode);
                     decreaseHightTree(parentNode);
                 }
             }
 
 
-            bool ContainEntity(ContainerPosition<T> pos1, ContainerPosition<T> pos2) const {
-                
-                int pos1MinX = getMinX(pos1);
-                int pos1MaxX = getMaxX(pos1);
-                int pos1MinY = getMinY(pos1);
-                int pos1MaxY = getMaxY(pos1);
-                int pos1MinZ = getMinZ(pos1);
-                int pos1MaxZ = getMaxZ(pos1);
-                
-
-                int pos2MinX = getMinX(pos2);
-                int pos2MaxX = getMaxX(pos2);
-                int pos2MinY = getMinY(pos2);
-                int pos2MaxY = getMaxY(pos2);
-                int pos2MinZ = getMinZ(pos2);
-                int pos2MaxZ = getMaxZ(pos2);
-
-
-                return (pos1MinX <= pos2MaxX && pos1MaxX >= pos2MinX) &&
-                    (pos1MinY <= pos2MaxY && pos1MaxY >= pos2MinY) &&
-                    (pos1MinZ <= pos2MaxZ && pos1MaxZ >= pos2MinZ);
+            bool checkCollision(const BoundingBox<T>& bounds) const {
+                if constexpr (std::is_same_v<std::decay_t<decltype(T::x)>, int>) {
+                    if(root == NO_NODE){
+                        return false;
+                    }
+                    OverlapQuery query{bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z};
+                    return collides(nodes[root], bounds, query);
+                } else {
+                    return !queryRange(bounds, [](const BoundingBox<T>&, const N&){
+                        return false;
+                    });
+                }
             }
 
 
-            bool checkCollision(N container, ContainerPosition<T> pos, std::vector<std::pair<ContainerPosition<T>, N>> copy) const {
-                for(auto it : copy){
-                    if(ContainEntity(it.first, pos)){
+            // Node items are stored as coordinate arrays, so the overlap kernel reads them in place.
+            bool collides(const Node& node, const BoundingBox<T>& bounds, const OverlapQuery& query) const {
+                if(!node.loose.intersects(bounds)){
+                    return false;
+                }
+                for(size_t start = 0; start < node.con.size(); start += OVERLAP_BLOCK){
+                    size_t count = std::min(OVERLAP_BLOCK, node.con.size() - start);
+                    if(overlapMask(node.con.overlapBoxes(start), count, query) != 0){
                         return true;
                     }
                 }
-                return false; 
+                if(!node.isLeaf()){
+                    for(NodeIndex i = 0; i < 8; ++i){
+                        if(collides(nodes[node.firstChild + i], bounds, query)){
+                            return true;
+                        }
+                    }
+                }
+                return false;
             }
 
                 
@@ -0,0 +1,157 @@
+#ifndef OVERLAPKERNEL_HPP
+#define OVERLAPKERNEL_HPP
+
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OVERLAP_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @file OverlapKernel.hpp
+ * @brief Batched test of one query box against a block of boxes.
+ *
+ * Boxes are given as structure-of-arrays: six arrays with the minimum and
+ * maximum of every axis. A box overlaps the query when it shares at least one
+ * point with it (borders included), the same rule as BoundingBox::intersects.
+ * Blocks hold at most OVERLAP_BLOCK boxes; bit i of the result is set when box
+ * i overlaps. The AVX2 or SSE2 implementation is picked once at runtime, with a
+ * scalar fallback on other targets.
+ */
+
+inline constexpr size_t OVERLAP_BLOCK = 64;
+
+/**
+ * @struct OverlapBoxes
+ * @brief Pointers to the six coordinate arrays of a block of boxes.
+ */
+
+struct OverlapBoxes{
+    const int* minX;
+    const int* minY;
+    const int* minZ;
+    const int* maxX;
+    const int* maxY;
+    const int* maxZ;
+};
+
+/**
+ * @struct OverlapQuery
+ * @brief Query box tested against every box of a block.
+ */
+
+struct OverlapQuery{
+    int minX, minY, minZ;
+    int maxX, maxY, maxZ;
+};
+
+using OverlapKernel = std::uint64_t (*)(const OverlapBoxes&, size_t, const OverlapQuery&);
+
+inline bool overlapsScalar(const OverlapBoxes& boxes, size_t i, const OverlapQuery& q){
+    return boxes.minX[i] <= q.maxX && q.minX <= boxes.maxX[i] &&
+           boxes.minY[i] <= q.maxY && q.minY <= boxes.maxY[i] &&
+           boxes.minZ[i] <= q.maxZ && q.minZ <= boxes.maxZ[i];
+}
+
+/**
+ * @brief Portable implementation of the kernel.
+ * @param boxes Block of boxes.
+ * @param count Number of boxes in the block, at most OVERLAP_BLOCK.
+ * @param query Query box.
+ * @return Mask of overlapping boxes.
+ */
+inline std::uint64_t overlapMaskScalar(const OverlapBoxes& boxes, size_t count, const OverlapQuery& query){
+    std::uint64_t mask = 0;
+    for(size_t i = 0; i < count; ++i){
+        mask |= static_cast<std::uint64_t>(overlapsScalar(boxes, i, query)) << i;
+    }
+    return mask;
+}
+
+#ifdef OVERLAP_KERNEL_X86
+
+__attribute__((target("sse2")))
+inline std::uint64_t overlapMaskSSE2(const OverlapBoxes& boxes, size_t count, const OverlapQuery& query){
+    const __m128i qMinX = _mm_set1_epi32(query.minX), qMaxX = _mm_set1_epi32(query.maxX);
+    const __m128i qMinY = _mm_set1_epi32(query.minY), qMaxY = _mm_set1_epi32(query.maxY);
+    const __m128i qMinZ = _mm_set1_epi32(query.minZ), qMaxZ = _mm_set1_epi32(query.maxZ);
+    std::uint64_t mask = 0;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        // A box misses when it starts after the query ends or ends before it starts.
+        __m128i miss = _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(boxes.minX + i)), qMaxX);
+        miss = _mm_or_si128(miss, _mm_cmpgt_epi32(qMinX, _mm_loadu_si128(reinterpret_cast<const __m128i*>(boxes.maxX + i))));
+        miss = _mm_or_si128(miss, _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(boxes.minY + i)), qMaxY));
+        miss = _mm_or_si128(miss, _mm_cmpgt_epi32(qMinY, _mm_loadu_si128(reinterpret_cast<const __m128i*>(boxes.maxY + i))));
+        miss = _mm_or_si128(miss, _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(boxes.minZ + i)), qMaxZ));
+        miss = _mm_or_si128(miss, _mm_cmpgt_epi32(qMinZ, _mm_loadu_si128(reinterpret_cast<const __m128i*>(boxes.maxZ + i))));
+        std::uint64_t hits = ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(miss))) & 0xFu;
+        mask |= hits << i;
+    }
+    for(; i < count; ++i){
+        mask |= static_cast<std::uint64_t>(overlapsScalar(boxes, i, query)) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+inline std::uint64_t overlapMaskAVX2(const OverlapBoxes& boxes, size_t count, const OverlapQuery& query){
+    const __m256i qMinX = _mm256_set1_epi32(query.minX), qMaxX = _mm256_set1_epi32(query.maxX);
+    const __m256i qMinY = _mm256_set1_epi32(query.minY), qMaxY = _mm256_set1_epi32(query.maxY);
+    const __m256i qMinZ = _mm256_set1_epi32(query.minZ), qMaxZ = _mm256_set1_epi32(query.maxZ);
+    std::uint64_t mask = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256i miss = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxes.minX + i)), qMaxX);
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi32(qMinX, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxes.maxX + i))));
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxes.minY + i)), qMaxY));
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi32(qMinY, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxes.maxY + i))));
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxes.minZ + i)), qMaxZ));
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi32(qMinZ, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxes.maxZ + i))));
+        std::uint64_t hits = ~static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(miss))) & 0xFFu;
+        mask |= hits << i;
+    }
+    for(; i < count; ++i){
+        mask |= static_cast<std::uint64_t>(overlapsScalar(boxes, i, query)) << i;
+    }
+    return mask;
+}
+
+#endif
+
+/**
+ * @brief Get the fastest kernel supported by the running CPU.
+ * @return Pointer to the kernel, resolved on the first call.
+ */
+inline OverlapKernel overlapKernel(){
+    static const OverlapKernel kernel = []() -> OverlapKernel {
+#ifdef OVERLAP_KERNEL_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")){
+            return overlapMaskAVX2;
+        }
+        if(__builtin_cpu_supports("sse2")){
+            return overlapMaskSSE2;
+        }
+#endif
+        return overlapMaskScalar;
+    }();
+    return kernel;
+}
+
+/**
+ * @brief Test a query box against a block of boxes.
+ * @param boxes Block of boxes.
+ * @param count Number of boxes in the block, at most OVERLAP_BLOCK.
+ * @param query Query box.
+ * @return Mask with bit i set when box i overlaps the query.
+ */
+inline std::uint64_t overlapMask(const OverlapBoxes& boxes, size_t count, const OverlapQuery& query){
+    return overlapKernel()(boxes, count, query);
+}
+
+
+#endif
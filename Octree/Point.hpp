@@ -1,6 +1,7 @@
 #ifndef POINT_HPP
 #define POINT_HPP
 #include <tuple>
+#include <functional>
 
 template <typename T>
 struct Point{
@@ -29,4 +30,15 @@ struct Point{
     Point(){}
 };
 
+
+template <typename T>
+struct PointHash{
+    size_t operator()(const Point<T>& p) const {
+        size_t h = std::hash<T>{}(p.x);
+        h = h * 1000003u ^ std::hash<T>{}(p.y);
+        h = h * 1000003u ^ std::hash<T>{}(p.z);
+        return h;
+    }
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef EXTREMEPOINTS_HPP
+#define EXTREMEPOINTS_HPP
+
+
+#include <set>
+#include <vector>
+#include <limits>
+#include "../Octree/Octree.hpp"
+
+/**
+ * @class ExtremePoints
+ * @brief Incremental set of candidate anchors for automatic placement.
+ *
+ * Every placed container contributes the points right behind its far faces
+ * (and their projections to the floor), removed containers give their anchor
+ * back. Points covered by a newly placed container are dropped. The set is
+ * ordered like the storage scan (Y, then X, then Z) so the first candidate
+ * that fits is the one a full scan would prefer among the candidates.
+ *
+ * While a log is open every point added or dropped is recorded, so undo()
+ * can bring the set back to any mark of the log exactly.
+ */
+
+class ExtremePoints{
+    private:
+        struct ScanOrder{
+            bool operator()(const Point<int>& a, const Point<int>& b) const{
+                return std::tie(a.y, a.x, a.z) < std::tie(b.y, b.x, b.z);
+            }
+        };
+        std::set<Point<int>, ScanOrder> points;
+        Point<int> limit{0, 0, 0};
+        /// Points added (true) or dropped (false) since the log was opened.
+        std::vector<std::pair<Point<int>, bool>> changes;
+        bool logging = false;
+
+        void add(const Point<int>& p){
+            if(p.x >= 1 && p.y >= 1 && p.z >= 1 && p.x < limit.x && p.y < limit.y && p.z < limit.z){
+                if(points.insert(p).second && logging){
+                    changes.emplace_back(p, true);
+                }
+            }
+        }
+
+    public:
+        ExtremePoints(){}
+        /**
+         * @brief Create the index for an empty storage.
+         * @param bounds Bounding box of the storage.
+         */
+        explicit ExtremePoints(const BoundingBox<Point<int>>& bounds) : limit(bounds.max) {
+            add(Point<int>(1, 1, 1));
+        }
+
+        /**
+         * @brief Register a placed container.
+         * @param bounds Bounds of the container.
+         */
+        void occupy(const BoundingBox<Point<int>>& bounds){
+            // Points are ordered by Y first, so only the slab of the container's Y range is scanned.
+            auto it = points.lower_bound(Point<int>(std::numeric_limits<int>::min(), bounds.min.y, std::numeric_limits<int>::min()));
+            while(it != points.end() && it->y <= bounds.max.y){
+                if(it->x >= bounds.min.x && it->x <= bounds.max.x &&
+                   it->z >= bounds.min.z && it->z <= bounds.max.z){
+                    if(logging){
+                        changes.emplace_back(*it, false);
+                    }
+                    it = points.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            add(Point<int>(bounds.max.x + 1, bounds.min.y, bounds.min.z));
+            add(Point<int>(bounds.min.x, bounds.max.y + 1, bounds.min.z));
+            add(Point<int>(bounds.min.x, bounds.min.y, bounds.max.z + 1));
+            if(bounds.min.z > 1){
+                add(Point<int>(bounds.max.x + 1, bounds.min.y, 1));
+                add(Point<int>(bounds.min.x, bounds.max.y + 1, 1));
+            }
+        }
+
+        /**
+         * @brief Register a removed container.
+         * @param bounds Bounds the container occupied.
+         */
+        void release(const BoundingBox<Point<int>>& bounds){
+            add(bounds.min);
+        }
+
+        /**
+         * @brief Get the current candidates in scan order.
+         * @return Vector of candidate anchors.
+         */
+        std::vector<Point<int>> candidates() const{
+            return std::vector<Point<int>>(points.begin(), points.end());
+        }
+
+        size_t size() const{
+            return points.size();
+        }
+
+        /**
+         * @brief Start recording changes, or keep recording if already started.
+         * @return Mark to undo to.
+         */
+        size_t beginLog(){
+            logging = true;
+            return changes.size();
+        }
+
+        /**
+         * @brief Stop recording and forget the recorded changes.
+         */
+        void endLog(){
+            logging = false;
+            changes.clear();
+        }
+
+        /**
+         * @brief Revert every change recorded after a mark, newest first.
+         * @param mark Mark returned by beginLog().
+         */
+        void undo(size_t mark){
+            while(changes.size() > mark){
+                auto [point, added] = changes.back();
+                changes.pop_back();
+                if(added){
+                    points.erase(point);
+                }else{
+                    points.insert(point);
+                }
+            }
+        }
+};
+
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef HEIGHTMAP_HPP
+#define HEIGHTMAP_HPP
+
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "../Octree/Octree.hpp"
+
+/**
+ * @class HeightMap
+ * @brief Top of the highest container over every (x, y) column of a storage.
+ *
+ * A container covers the columns of its footprint, borders included. Every
+ * column keeps the highest Z reached by a container covering it and that
+ * container's handle; 0 stands for the bare floor and for no container.
+ * Placing a container only raises columns, removing one needs the remaining
+ * containers over its footprint to rebuild those columns.
+ */
+
+class HeightMap{
+    private:
+        Point<int> origin{0, 0, 0};
+        int columnsX = 0;
+        int columnsY = 0;
+        std::vector<int> tops;
+        std::vector<std::uint64_t> owners;
+
+        size_t index(int x, int y) const{
+            return static_cast<size_t>(y - origin.y) * columnsX + (x - origin.x);
+        }
+
+        // Clips a footprint to the map, returning false if nothing is left.
+        bool clip(const BoundingBox<Point<int>>& box, int& x0, int& x1, int& y0, int& y1) const{
+            x0 = std::max(box.min.x, origin.x);
+            y0 = std::max(box.min.y, origin.y);
+            x1 = std::min(box.max.x, origin.x + columnsX - 1);
+            y1 = std::min(box.max.y, origin.y + columnsY - 1);
+            return x0 <= x1 && y0 <= y1;
+        }
+
+    public:
+        HeightMap(){}
+        /**
+         * @brief Create the map of an empty storage.
+         * @param bounds Bounding box of the storage.
+         */
+        explicit HeightMap(const BoundingBox<Point<int>>& bounds)
+            : origin(bounds.min), columnsX(bounds.max.x - bounds.min.x + 1), columnsY(bounds.max.y - bounds.min.y + 1),
+              tops(static_cast<size_t>(columnsX) * columnsY, 0), owners(tops.size(), 0) {}
+
+        /**
+         * @brief Register a placed container.
+         * @param box Bounds of the container.
+         * @param handle Handle of the container.
+         */
+        void raise(const BoundingBox<Point<int>>& box, std::uint64_t handle){
+            raise(box, handle, box);
+        }
+
+        /**
+         * @brief Register the part of a container over a footprint.
+         * @param box Bounds of the container.
+         * @param handle Handle of the container.
+         * @param footprint Only columns inside this box are touched.
+         */
+        void raise(const BoundingBox<Point<int>>& box, std::uint64_t handle, const BoundingBox<Point<int>>& footprint){
+            int x0, x1, y0, y1;
+            BoundingBox<Point<int>> area(Point<int>(std::max(box.min.x, footprint.min.x), std::max(box.min.y, footprint.min.y), 0),
+                                         Point<int>(std::min(box.max.x, footprint.max.x), std::min(box.max.y, footprint.max.y), 0));
+            if(!clip(area, x0, x1, y0, y1)){
+                return;
+            }
+            for(int y = y0; y <= y1; ++y){
+                size_t row = index(x0, y);
+                for(int x = 0; x <= x1 - x0; ++x){
+                    if(box.max.z > tops[row + x]){
+                        tops[row + x] = box.max.z;
+                        owners[row + x] = handle;
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Reset the columns of a footprint to the bare floor before rebuilding them.
+         * @param footprint Columns to reset.
+         */
+        void clear(const BoundingBox<Point<int>>& footprint){
+            int x0, x1, y0, y1;
+            if(!clip(footprint, x0, x1, y0, y1)){
+                return;
+            }
+            for(int y = y0; y <= y1; ++y){
+                size_t row = index(x0, y);
+                std::fill(tops.begin() + row, tops.begin() + row + (x1 - x0 + 1), 0);
+                std::fill(owners.begin() + row, owners.begin() + row + (x1 - x0 + 1), 0);
+            }
+        }
+
+        /**
+         * @brief Get the top of a column.
+         * @return Highest Z of a container over the column, 0 for the floor or outside the map.
+         */
+        int top(int x, int y) const{
+            if(x < origin.x || y < origin.y || x >= origin.x + columnsX || y >= origin.y + columnsY){
+                return 0;
+            }
+            return tops[index(x, y)];
+        }
+
+        /**
+         * @brief Get the handle of the container forming the top of a column.
+         * @return Handle, or 0 if the column is bare.
+         */
+        std::uint64_t owner(int x, int y) const{
+            if(x < origin.x || y < origin.y || x >= origin.x + columnsX || y >= origin.y + columnsY){
+                return 0;
+            }
+            return owners[index(x, y)];
+        }
+
+        /**
+         * @brief Get the highest top over a footprint.
+         * @param footprint Columns to inspect, Z is ignored.
+         * @return Highest top, 0 if every column is bare.
+         */
+        int highest(const BoundingBox<Point<int>>& footprint) const{
+            int x0, x1, y0, y1;
+            int result = 0;
+            if(!clip(footprint, x0, x1, y0, y1)){
+                return result;
+            }
+            for(int y = y0; y <= y1; ++y){
+                size_t row = index(x0, y);
+                result = std::max(result, *std::max_element(tops.begin() + row, tops.begin() + row + (x1 - x0 + 1)));
+            }
+            return result;
+        }
+};
+
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef MUTATIONJOURNAL_HPP
+#define MUTATIONJOURNAL_HPP
+
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+/**
+ * @class MutationJournal
+ * @brief Undo log of the insertions and removals made by a multi-step operation.
+ *
+ * An operation opens the journal with begin() and keeps the returned mark.
+ * While the journal is open every insertion and removal is recorded, and
+ * rollback() hands the entries after the mark back newest first so they can
+ * be undone directly, without copying or checking anything again. Operations
+ * may nest: an inner commit keeps its entries for the outer operation, the
+ * entries are dropped when the outermost operation commits.
+ *
+ * @tparam Payload Type of the stored objects.
+ * @tparam Anchor Type of the positions they are stored at.
+ * @tparam Handle Type of their handles.
+ */
+
+template <typename Payload, typename Anchor, typename Handle>
+class MutationJournal{
+    public:
+        struct Entry{
+            bool inserted;
+            Payload payload;
+            Anchor anchor;
+            Handle handle;
+            /// Id the payload had before it was inserted.
+            std::string id;
+        };
+
+    private:
+        std::vector<Entry> entries;
+        size_t depth = 0;
+        bool replaying = false;
+
+    public:
+        MutationJournal(){}
+
+        /**
+         * @brief Open the journal for an operation.
+         * @return Mark to roll back to.
+         */
+        size_t begin(){
+            ++depth;
+            return entries.size();
+        }
+
+        bool open() const{
+            return depth > 0;
+        }
+
+        bool recording() const{
+            return depth > 0 && !replaying;
+        }
+
+        void inserted(const Payload& payload, const Anchor& anchor, Handle handle, const std::string& id){
+            if(recording()){
+                entries.push_back(Entry{true, payload, anchor, handle, id});
+            }
+        }
+
+        void erased(const Payload& payload, const Anchor& anchor, Handle handle){
+            if(recording()){
+                entries.push_back(Entry{false, payload, anchor, handle, std::string()});
+            }
+        }
+
+        /**
+         * @brief Close an operation, keeping its changes.
+         */
+        void commit(){
+            if(--depth == 0){
+                entries.clear();
+            }
+        }
+
+        /**
+         * @brief Close an operation, undoing its changes.
+         * @param mark Mark returned by begin().
+         * @param undo Callable taking (const Entry&), called newest first. Changes it makes are not recorded.
+         */
+        template<typename Undo>
+        void rollback(size_t mark, Undo&& undo){
+            replaying = true;
+            while(entries.size() > mark){
+                undo(entries.back());
+                entries.pop_back();
+            }
+            replaying = false;
+            commit();
+        }
+
+        size_t size() const{
+            return entries.size();
+        }
+};
+
+
+#endif
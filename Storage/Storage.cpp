@@ -6,8 +6,10 @@
 #include <algorithm>
 #include <exception>
 #include <numeric>
+#include <iterator>
 #include <cmath>
 #include <vector>
+#include <charconv>
 
 
   void Storage::addExternalCheckFunction(const std::function<void(Storage&, std::shared_ptr<IContainer>, ContainerPosition<Point<int>>)>& externalFunc) {
@@ -22,13 +24,9 @@ Storage::Storage(int number, int length, int width, int height, double temperatu
     this->height = height;
     this->temperature = temperature;
     BoundingBox<Point<int>> bound(Point<int>(0, 0, 0), Point<int>(length, width, height));
-    this->containers = Octree<Point<int>, std::shared_ptr<IContainer>>(bound);
-    this->checker.addCheckFunction([this](Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> position) {
-        checkTemperature(storage, container, position);
-    });
-    this->checker.addCheckFunction([this](Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> position) {
-        checkPressure(storage, container, position);
-    });
+    this->containers = Octree<Point<int>, std::shared_ptr<IContainer>>(bound, LOOSENESS);
+    this->freeSpace = ExtremePoints(bound);
+    this->heights = HeightMap(bound);
 }
 
 
@@ -49,12 +47,8 @@ Storage& Storage::operator=(const Storage& other) {
             width = other.width;
             height = other.height;
             temperature = other.temperature;
-            containers = (other).containers.Clone();
-            auto i = other.containers.searchDepth();
-            std::sort(i.begin(), i.end(), comparePosition);
-            for(auto& it : i){
-                addContainer(it.second->Clone(), it.first.LLDown.x, it.first.LLDown.y, it.first.LLDown.z);
-            }
+            pool = other.pool;
+            shareContainersFrom(other);
             Checker checker = other.checker;
         }
         return *this;
@@ -62,33 +56,125 @@ Storage& Storage::operator=(const Storage& other) {
 
 
 Storage::Storage(const Storage& other)
-        : number(other.number), length(other.length), width(other.width), height(other.height), temperature(other.temperature) {
-        containers = other.containers.Clone(); // Используем интерфейс Clone для копирования
-        auto i = other.containers.searchDepth();
-        std::sort(i.begin(), i.end(), comparePosition);
-        for(auto it : i){
-            std::cout << it.second->getId() << std::endl;
-        }
-        for(auto& it : i){
-            addContainer(it.second->Clone(), it.first.LLDown.x, it.first.LLDown.y, it.first.LLDown.z);
-        }
+        : number(other.number), length(other.length), width(other.width), height(other.height), temperature(other.temperature), pool(other.pool) {
+        shareContainersFrom(other);
         Checker checker = other.checker;
     }
 
 
+void Storage::shareContainersFrom(const Storage& other){
+    // The clone shares octree nodes and container objects with other until either side changes them.
+    containers = other.containers.Clone();
+    // The new epoch retires every ownership record, so none are worth copying.
+    ownedPayloads.clear();
+    shareEpoch.store(other.shareEpoch.fetch_add(1) + 1);
+    freeSpace = other.freeSpace;
+    heights = other.heights;
+    support = other.support;
+    handleAnchors = other.handleAnchors;
+    anchorHandles = other.anchorHandles;
+    nextHandle = other.nextHandle;
+    publish();
+}
+
+
+// Readers of a storage in snapshot mode work on the last published version of
+// the octree, so they neither wait for nor see a half-finished placement.
+// Copies of a storage start with the mode off.
+void Storage::enableSnapshotReads(bool enable){
+    snapshotReads.store(enable);
+    if(enable){
+        publish();
+    }else{
+        std::lock_guard<std::mutex> lock(publishMtx);
+        published.reset();
+    }
+}
+
+
+StorageSnapshot Storage::snapshot() const{
+    {
+        std::lock_guard<std::mutex> lock(publishMtx);
+        if(published != nullptr){
+            return published;
+        }
+    }
+    // Without snapshot mode there is no published version to pin, so take a private one.
+    shareEpoch.fetch_add(1);
+    return std::make_shared<const Octree<Point<int>, std::shared_ptr<IContainer>>>(containers.Clone());
+}
+
+
+void Storage::publish(){
+    if(snapshotReads.load()){
+        // The clone shares every node chunk; the next write to the live tree copies only what it touches.
+        StorageSnapshot version = std::make_shared<const Octree<Point<int>, std::shared_ptr<IContainer>>>(containers.Clone());
+        shareEpoch.fetch_add(1);
+        std::lock_guard<std::mutex> lock(publishMtx);
+        // Only the pointer is swapped under the lock; the old version is released by its last reader.
+        published.swap(version);
+    }
+}
+
+
+// Copies and snapshots of a storage hold the same container objects, so a
+// container changed after it was shared is changed on a private copy. Containers
+// that were never shared, or were already copied since, are kept as they are.
+std::shared_ptr<IContainer> Storage::ownPayload(ContainerHandle handle, const std::shared_ptr<IContainer>& container){
+    std::uint64_t epoch = shareEpoch.load();
+    auto it = ownedPayloads.find(handle);
+    if(it != ownedPayloads.end() && it->second.first == epoch && it->second.second == container.get()){
+        return container;
+    }
+    std::shared_ptr<IContainer> copy = container->Clone();
+    ownedPayloads[handle] = std::make_pair(epoch, copy.get());
+    return copy;
+}
+
+
+StorageSnapshot Storage::readTree() const{
+    std::lock_guard<std::mutex> lock(publishMtx);
+    if(published == nullptr){
+        // Not owning: the live tree outlives the call that reads it.
+        return StorageSnapshot(StorageSnapshot(), &containers);
+    }
+    return published;
+}
+
+
+void Storage::copyContainersFrom(const Storage& other){
+    std::vector<Octree<Point<int>, std::shared_ptr<IContainer>>::Item> items;
+    other.containers.queryRange(other.containers.getBounds(),
+        [&](const BoundingBox<Point<int>>& bounds, const std::shared_ptr<IContainer>& container){
+            items.emplace_back(bounds, container->Clone());
+            return true;
+        });
+    // Positions were validated when the containers entered other, so the tree is bulk-built.
+    containers.bulkLoad(items);
+    freeSpace = ExtremePoints(containers.getBounds());
+    std::sort(items.begin(), items.end(), [](const auto& a, const auto& b){
+        return a.first.min.z < b.first.min.z;
+    });
+    heights = HeightMap(containers.getBounds());
+    for(const auto& item : items){
+        freeSpace.occupy(item.first);
+        heights.raise(item.first, other.anchorHandles.at(item.first.min));
+    }
+    // Positions and handles are kept, so the support relation is unchanged.
+    support = other.support;
+    handleAnchors = other.handleAnchors;
+    anchorHandles = other.anchorHandles;
+    nextHandle = std::max(nextHandle, other.nextHandle);
+}
+
+
 void Storage::getSize(int l, int w, int h){
     if(l < length || w < width || h < height){
         throw std::runtime_error("Storage l|w|h must be greater than or equal to length|width|height");
     }
     Storage newStorage(this->number, l, w, h, this->temperature);
-    auto i = this->containers.searchDepth();
-    std::sort(i.begin(), i.end(), comparePosition);
-    for(auto& it : i){
-        std::cout << it.second->getId() << std::endl;
-    }
-    for(auto& it : i){
-        newStorage.addContainer(it.second->Clone(), it.first.LLDown.x, it.first.LLDown.y, it.first.LLDown.z);
-    }
+    newStorage.pool = pool;
+    newStorage.copyContainersFrom(*this);
     *this = newStorage;
 }
 
@@ -96,65 +182,66 @@ void Storage::getSize(int l, int w, int h){
 //Вставка
 
 
+BoundingBox<Point<int>> Storage::columnRange(const BoundingBox<Point<int>>& bounds, int zMin, int zMax) const{
+    return BoundingBox<Point<int>>(Point<int>(bounds.min.x, bounds.min.y, zMin), Point<int>(bounds.max.x, bounds.max.y, zMax));
+}
+
+
 std::vector<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> Storage::searchUnderContainer(ContainerPosition<Point<int>>& position){
     std::vector<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> result;
-    int minX = Octree<Point<int>, std::shared_ptr<IContainer>>::getMinX(position);
-    int maxX = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxX(position);
-    int minY = Octree<Point<int>, std::shared_ptr<IContainer>>::getMinY(position);
-    int maxY = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxY(position);
-    int minZ = Octree<Point<int>, std::shared_ptr<IContainer>>::getMinZ(position);
-    std::vector<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> current;
-    {
+    BoundingBox<Point<int>> box = Octree<Point<int>, std::shared_ptr<IContainer>>::boundsOf(position);
+    int minZ = box.min.z;
     std::shared_lock<std::shared_mutex> lock(smtx);
-    current = containers.searchDepth();
-    }
-    for (const auto& container : current) {
-        const ContainerPosition<Point<int>>& containerPos = container.first;
-
-        if (Octree<Point<int>, std::shared_ptr<IContainer>>::getMinX(containerPos) <= maxX && Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxX(containerPos) >= minX &&
-            Octree<Point<int>, std::shared_ptr<IContainer>>::getMinY(containerPos) <= maxY && Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxY(containerPos) >= minY &&
-            Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxZ(containerPos) < minZ) {
-                result.push_back(container);
-                continue;
-        }
-    }
+    containers.queryRange(columnRange(box, containers.getBounds().min.z, minZ - 1),
+        [&](const BoundingBox<Point<int>>& bounds, const std::shared_ptr<IContainer>& container){
+            if(bounds.max.z < minZ){
+                result.emplace_back(Octree<Point<int>, std::shared_ptr<IContainer>>::positionOf(bounds), container);
+            }
+            return true;
+        });
     std::sort(result.begin(), result.end(), comparePosition);
     return result;
 }
 
 
-std::vector<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> Storage::searchUpperContainer(ContainerPosition<Point<int>>& position){
-    std::vector<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> result;
-    int minX = Octree<Point<int>, std::shared_ptr<IContainer>>::getMinX(position);
-    int maxX = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxX(position);
-    int minY = Octree<Point<int>, std::shared_ptr<IContainer>>::getMinY(position);
-    int maxY = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxY(position);
-    int maxZ = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxZ(position);
-    auto current = containers.searchDepth();
-    for (const auto& container : current) {
-        const ContainerPosition<Point<int>>& containerPos = container.first;
-        
-        if (Octree<Point<int>, std::shared_ptr<IContainer>>::getMinX(containerPos) <= maxX && Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxX(containerPos) >= minX &&
-            Octree<Point<int>, std::shared_ptr<IContainer>>::getMinY(containerPos) <= maxY && Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxY(containerPos) >= minY &&
-            Octree<Point<int>, std::shared_ptr<IContainer>>::getMinZ(containerPos) > maxZ) {
-                result.push_back(container);
-                continue;
-        }
-    }
-    std::sort(result.begin(), result.end(), comparePositionReverse);
-    return result;
+double Storage::pressureLimit(const std::shared_ptr<IContainer>& container){
+    auto fragileContainer = std::dynamic_pointer_cast<IFragileContainer>(container);
+    if(fragileContainer == nullptr || (fragileContainer->isType() != "Fragile" && fragileContainer->isType() != "Fragile and Refraged Container")){
+        return std::numeric_limits<double>::infinity();
+    }
+    return fragileContainer->getMaxPressure();
 }
 
 
+// Containers whose tops touch the bottom of the given bounds.
+std::vector<ContainerHandle> Storage::restingUnder(const BoundingBox<Point<int>>& bounds) const{
+    std::vector<ContainerHandle> result;
+    int surface = bounds.min.z - 1;
+    containers.queryRange(columnRange(bounds, surface, surface),
+        [&](const BoundingBox<Point<int>>& box, const std::shared_ptr<IContainer>&){
+            auto it = anchorHandles.find(box.min);
+            if(box.max.z == surface && it != anchorHandles.end()){
+                result.push_back(it->second);
+            }
+            return true;
+        });
+    return result;
+}
+
 
-double Storage::calculatemass(std::vector<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> con, size_t it){
-    double mass = 0;
-    for(size_t i = it + 1; i < con.size(); i++){
-        if((con[i].second)!= nullptr){
-            mass += (*con[i].second).getMass();
-        }
-    }
-    return mass;
+// Containers whose bottoms touch the top of the given bounds.
+std::vector<ContainerHandle> Storage::restingOn(const BoundingBox<Point<int>>& bounds) const{
+    std::vector<ContainerHandle> result;
+    int ceiling = bounds.max.z + 1;
+    containers.queryRange(columnRange(bounds, ceiling, ceiling),
+        [&](const BoundingBox<Point<int>>& box, const std::shared_ptr<IContainer>&){
+            auto it = anchorHandles.find(box.min);
+            if(box.min.z == ceiling && it != anchorHandles.end()){
+                result.push_back(it->second);
+            }
+            return true;
+        });
+    return result;
 }
 
 
@@ -186,20 +273,197 @@ bool Storage::checkSupport(ContainerPosition<Point<int>>& position, std::vector<
 }
 
 void Storage::addContainer(std::shared_ptr<IContainer> container, int X, int Y, int Z){
-    if(X < 1 || Y < 1 || Z < 1){
-        throw std::invalid_argument("Coordinates should be positive");
+    PlaceResult result = tryPlace(container, X, Y, Z);
+    if(result != PlaceResult::Ok){
+        throw std::invalid_argument(describe(result));
+    }
+}
+
+
+PlaceResult Storage::probe(std::shared_ptr<IContainer> container, int X, int Y, int Z){
+    if(container == nullptr || X < 1 || Y < 1 || Z < 1){
+        return PlaceResult::OutOfBounds;
     }
     ContainerPosition<Point<int>> pos = Octree<Point<int>, std::shared_ptr<IContainer>>::calculateContainerPosition(X, Y, Z, container);
-    auto cache = containers.SearchInsert(container, Point<int>(X, Y, Z));
-    if(cache == false){
-        throw std::invalid_argument("Valid place for container doesn t exist");
+    {
+        std::shared_lock<std::shared_mutex> lock(smtx);
+        if(!containers.getBounds().contains(Octree<Point<int>, std::shared_ptr<IContainer>>::calculateBounds(X, Y, Z, container))){
+            return PlaceResult::OutOfBounds;
+        }
+        if(containers.checkCollisions(container, Point<int>(X, Y, Z))){
+            return PlaceResult::Collision;
+        }
+    }
+    PlaceResult result = probeTemperature(container);
+    if(result == PlaceResult::Ok){
+        result = probePressure(container, pos);
+    }
+    if(result == PlaceResult::Ok && !checker.tryChecks(*this, container, pos)){
+        result = PlaceResult::Vetoed;
+    }
+    return result;
+}
+
+
+PlaceResult Storage::tryPlace(std::shared_ptr<IContainer> container, int X, int Y, int Z){
+    PlaceResult result = placeAt(container, Point<int>(X, Y, Z), 0);
+    if(result == PlaceResult::Ok){
+        publish();
+    }
+    return result;
+}
+
+
+PlaceResult Storage::placeAt(std::shared_ptr<IContainer> container, const Point<int>& point, ContainerHandle handle){
+    PlaceResult result = probe(container, point.x, point.y, point.z);
+    if(result == PlaceResult::Ok){
+        insertContainer(container, point, handle);
     }
-    checker.applyChecks(*this ,container, pos);
-    (containers).push(container, Point<int>(X, Y, Z));
-    container->setId(X, Y, Z);
+    return result;
 }
 
 
+std::string Storage::describe(PlaceResult result){
+    switch (result)
+    {
+    case PlaceResult::Ok:
+        return "Container can be placed";
+    case PlaceResult::Collision:
+        return "Valid place for container doesn t exist";
+    case PlaceResult::OutOfBounds:
+        return "Container is out of storage bounds";
+    case PlaceResult::NoSupport:
+        return "Support doesn t exist";
+    case PlaceResult::Overpressure:
+        return "Container would be too heavy";
+    case PlaceResult::Temperature:
+        return "Container is too hot";
+    case PlaceResult::Vetoed:
+        return "Container rejected by external check";
+    }
+    return "Unknown placement result";
+}
+
+
+// Callers probe the place first, so a refused push means the storage is out of sync.
+ContainerHandle Storage::insertContainer(std::shared_ptr<IContainer> container, const Point<int>& point, ContainerHandle handle){
+    if(!containers.push(container, point)){
+        throw std::logic_error("Container does not fit at " + numeric(point));
+    }
+    return indexContainer(container, point, handle);
+}
+
+
+// Everything but the octree itself learns about a container placed at point.
+ContainerHandle Storage::indexContainer(std::shared_ptr<IContainer> container, const Point<int>& point, ContainerHandle handle){
+    std::string previousId = container->getId();
+    // Only ids that are not already the plain "X_Y_Z" of this anchor are rewritten.
+    Point<int> current(0, 0, 0);
+    if(previousId.find('.') != std::string::npos || !tryParsePoint(previousId, current) || !(current == point)){
+        container->setId(point.x, point.y, point.z);
+    }
+    BoundingBox<Point<int>> bounds = Octree<Point<int>, std::shared_ptr<IContainer>>::calculateBounds(point.x, point.y, point.z, container);
+    freeSpace.occupy(bounds);
+    if(handle == 0){
+        handle = nextHandle++;
+        ownedPayloads[handle] = std::make_pair(shareEpoch.load(), container.get());
+    }
+    heights.raise(bounds, handle);
+    support.attach(handle, bounds.min.z, container->getMass(), pressureLimit(container), restingUnder(bounds), restingOn(bounds));
+    handleAnchors[handle] = point;
+    anchorHandles[point] = handle;
+    journal.inserted(container, point, handle, previousId);
+    return handle;
+}
+
+
+// Undoes the journaled changes newest first. Every entry restores a state the
+// storage already had: an erased container goes back to a place the later
+// entries have already freed, so it is restored without a collision check and
+// nothing is probed again. The free-space candidates are then reverted from
+// their own log, which also takes back what the undo itself changed.
+void Storage::rollbackTo(size_t mark, size_t spaceMark){
+    journal.rollback(mark, [&](const auto& entry){
+        if(entry.inserted){
+            eraseContainer(containers.search(entry.anchor).first);
+            if(entry.payload->getId() != entry.id){
+                entry.payload->setId(entry.id);
+            }
+        }else{
+            containers.restore(entry.payload, entry.anchor);
+            indexContainer(entry.payload, entry.anchor, entry.handle);
+        }
+    });
+    freeSpace.undo(spaceMark);
+    if(!journal.open()){
+        freeSpace.endLog();
+    }
+}
+
+
+ContainerHandle Storage::eraseContainer(const ContainerPosition<Point<int>>& position){
+    std::shared_ptr<IContainer> erased;
+    if(journal.recording()){
+        try{
+            erased = containers.search(position.LLDown).second;
+        }catch(const std::invalid_argument&){
+            return 0;
+        }
+    }
+    if(!containers.remove(position.LLDown)){
+        return 0;
+    }
+    BoundingBox<Point<int>> box = Octree<Point<int>, std::shared_ptr<IContainer>>::boundsOf(position);
+    freeSpace.release(box);
+    // The columns under the removed container are rebuilt from whatever still stands on them.
+    heights.clear(box);
+    containers.queryRange(columnRange(box, containers.getBounds().min.z, containers.getBounds().max.z),
+        [&](const BoundingBox<Point<int>>& bounds, const std::shared_ptr<IContainer>&){
+            auto owner = anchorHandles.find(bounds.min);
+            heights.raise(bounds, owner == anchorHandles.end() ? 0 : owner->second, box);
+            return true;
+        });
+    auto it = anchorHandles.find(position.LLDown);
+    if(it == anchorHandles.end()){
+        return 0;
+    }
+    ContainerHandle handle = it->second;
+    support.detach(handle);
+    handleAnchors.erase(handle);
+    anchorHandles.erase(it);
+    journal.erased(erased, position.LLDown, handle);
+    return handle;
+}
+
+
+
+// The container rests on the columns under its middle, or under the middles of both X edges.
+bool Storage::isSupported(const BoundingBox<Point<int>>& bounds) const{
+    int surface = bounds.min.z - 1;
+    int midX = bounds.min.x + (bounds.max.x - bounds.min.x) / 2;
+    int midY = bounds.min.y + (bounds.max.y - bounds.min.y) / 2;
+    if(heights.top(midX, midY) == surface){
+        return true;
+    }
+    return heights.top(bounds.min.x, midY) == surface && heights.top(bounds.max.x, midY) == surface;
+}
+
+
+int Storage::restingHeight(std::shared_ptr<IContainer> container, int X, int Y) const{
+    BoundingBox<Point<int>> footprint = Octree<Point<int>, std::shared_ptr<IContainer>>::calculateBounds(X, Y, 1, container);
+    return heights.highest(footprint) + 1;
+}
+
+
+ContainerHandle Storage::topAt(int X, int Y) const{
+    return heights.owner(X, Y);
+}
+
+
+double Storage::loadOn(ContainerHandle handle) const{
+    return support.load(handle);
+}
+
 
 //Информация о складе
 std::string Storage::getInfoAboutStorage() const{
@@ -211,227 +475,371 @@ std::string Storage::getInfoAboutStorage() const{
 
 
 bool Storage::isNoTop(const ContainerPosition<Point<int>>& position){
-    int minX = Octree<Point<int>, std::shared_ptr<IContainer>>::getMinX(position);
-    int maxX = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxX(position);
-    int minY = Octree<Point<int>, std::shared_ptr<IContainer>>::getMinY(position);
-    int maxY = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxY(position);
-    int maxZ = Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxZ(position);
-    auto copy = containers.searchDepth();
-    
-    for(auto i : copy){
-        const ContainerPosition<Point<int>>& containerPos = i.first;
-        if (Octree<Point<int>, std::shared_ptr<IContainer>>::getMinX(containerPos) <= maxX && Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxX(containerPos) >= minX &&
-            Octree<Point<int>, std::shared_ptr<IContainer>>::getMinY(containerPos) <= maxY && Octree<Point<int>, std::shared_ptr<IContainer>>::getMaxY(containerPos) >= minY &&
-            Octree<Point<int>, std::shared_ptr<IContainer>>::getMinZ(containerPos) == maxZ + 1) {
-                return false;
-        }
-    }
-
-    return true;
+    BoundingBox<Point<int>> box = Octree<Point<int>, std::shared_ptr<IContainer>>::boundsOf(position);
+    int maxZ = box.max.z;
+    if(heights.highest(box) <= maxZ){
+        return true;
+    }
+    // Something is higher over the footprint; it may still float above a gap.
+    return containers.queryRange(columnRange(box, maxZ + 1, maxZ + 1),
+        [&](const BoundingBox<Point<int>>& bounds, const std::shared_ptr<IContainer>&){
+            return bounds.min.z != maxZ + 1;
+        });
 }
 
 
 //перемещения
 void Storage::moveContainer(std::string identification, int X, int Y, int Z){
+    moveContainer(getHandle(identification), X, Y, Z);
+}
+
+
+void Storage::moveContainer(ContainerHandle handle, int X, int Y, int Z){
     if(X < 1 || Y < 1 || Z < 1){
         throw std::invalid_argument("Invalid coordinate");
     }
-    Point<int> id = parsePoint(identification);
-    auto item = containers.search(id);
-    containers.remove(id);
+    auto item = find(handle);
+    Transaction transaction(*this);
+    eraseContainer(item.first);
     if(!isNoTop(item.first)){
-        containers.push(item.second, item.first.LLDown);
-        item.second->setId(item.first.LLDown.x, item.first.LLDown.y, item.first.LLDown.z); 
         throw std::invalid_argument("Not a top containerMove");
     }
-    try{
-        addContainer(item.second, X, Y, Z);
-    }catch(std::exception &e){
-        std::cerr << "Error: " << e.what() << std::endl;
-        containers.push(item.second, item.first.LLDown);
-        item.second->setId(item.first.LLDown.x, item.first.LLDown.y, item.first.LLDown.z);
+    PlaceResult result = placeAt(ownPayload(handle, item.second), Point<int>(X, Y, Z), handle);
+    if(result != PlaceResult::Ok){
+        std::cerr << "Error: " << describe(result) << std::endl;
         throw std::invalid_argument("Can't move container "); 
     }
+    transaction.commit();
+    publish();
 }
 
 
 //Повороты 
 void Storage::rotateContainer(std::string identification, int method) {
-    Point<int> id = parsePoint(identification);
-    auto item = containers.search(id);
-    containers.remove(id);
+    rotateContainer(getHandle(identification), method);
+}
+
+
+void Storage::rotateContainer(ContainerHandle handle, int method) {
+    auto item = find(handle);
+    Transaction transaction(*this);
+    eraseContainer(item.first);
     std::shared_ptr<IContainer> container = item.second;
     if(container->isType() == "Fragile" || container->isType() == "Fragile and Refraged Container"){
-        containers.push(item.second, item.first.LLDown);
-        item.second->setId(item.first.LLDown.x, item.first.LLDown.y, item.first.LLDown.z);
         throw std::invalid_argument("Fragile container cannot be rotated");
     }
     ContainerPosition<Point<int>> pos = item.first;
     if(!isNoTop(pos)){
-        containers.push(item.second, item.first.LLDown);
-        item.second->setId(item.first.LLDown.x, item.first.LLDown.y, item.first.LLDown.z);
         throw std::invalid_argument("No top container");
     }
     int X = pos.LLDown.x;
     int Y = pos.LLDown.y;
     int Z = pos.LLDown.z;
     std::shared_ptr<IContainer> newContainer = container->Clone(0, method);
-    try{
-        addContainer(newContainer, X, Y, Z);
-        item.second.reset();
-    }catch(std::exception &e){
-        std::cerr << "Error: " << e.what() << std::endl;
-        containers.push(item.second, item.first.LLDown);
-        item.second->setId(item.first.LLDown.x, item.first.LLDown.y, item.first.LLDown.z);
-        newContainer.reset();
+    ownedPayloads[handle] = std::make_pair(shareEpoch.load(), newContainer.get());
+    PlaceResult result = placeAt(newContainer, Point<int>(X, Y, Z), handle);
+    if(result != PlaceResult::Ok){
+        std::cerr << "Error: " << describe(result) << std::endl;
         throw std::invalid_argument("Can't rotate container ");
     }
+    transaction.commit();
+    publish();
 }
 
 
-Point<int> Storage::multitread(std::shared_ptr<IContainer> container, int X, int Y, int Z){
-    ContainerPosition<Point<int>> pos = Octree<Point<int>, std::shared_ptr<IContainer>>::calculateContainerPosition(X, Y, Z, container);
-    {
-        std::shared_lock<std::shared_mutex> lock(smtx);    
-        auto cache = containers.checkCollisions(container, Point(X, Y, Z));
-        if(cache == true){
-            throw std::invalid_argument("Valid place for container doesn t exist");
-        }
-    }
-
-    checker.applyChecks(*this, container, pos);
+Point<int> Storage::cellAt(size_t index) const{
+    int z = static_cast<int>(index % height);
+    index /= height;
+    int x = static_cast<int>(index % length);
+    int y = static_cast<int>(index / length);
+    return Point<int>(x + 1, y + 1, z + 1);
+}
 
-    if(containerAdded.load()){
-        throw std::invalid_argument("Container already added");
+std::string Storage::addContainer(std::shared_ptr<IContainer> container){
+    if(placeAnywhere(container, 0) != PlaceResult::Ok){
+        return "_";
     }
+    publish();
+    return container->getId();
+}
 
-    {
-        std::unique_lock<std::mutex> lock(mtx);
-        if(!containerAdded.load()){
-            containerAdded.store(true);
-            return Point<int>{X, Y, Z};
-        }
-    }
 
-    throw std::invalid_argument("Container already added");
+// Failures in the order probe() checks them, so a search can report the one
+// that came closest to a placement.
+static constexpr PlaceResult PROBE_STAGES[] = {PlaceResult::OutOfBounds, PlaceResult::Collision, PlaceResult::Temperature,
+                                               PlaceResult::NoSupport, PlaceResult::Overpressure, PlaceResult::Vetoed};
+
+static int stageOf(PlaceResult result){
+    return static_cast<int>(std::find(std::begin(PROBE_STAGES), std::end(PROBE_STAGES), result) - std::begin(PROBE_STAGES));
 }
 
-bool Storage::addContainerR(std::shared_ptr<IContainer> container, int yStart, int yEnd, Point<int>& point){
-    for(int y = yStart; y <= yEnd; y++){
-        for(int x = 1; x <= length; x++){
-            for(int z = 1; z <= height; z++){
-                try{
-                    if(containerAdded.load()){
-                        return true;
-                    }
-                    Point<int> localPoint;
-                    localPoint = multitread(container, x, y, z);
-                    point = localPoint;
-                    return true;
-                }catch(std::invalid_argument &e){
-                }
-            }
+
+PlaceResult Storage::placeAnywhere(std::shared_ptr<IContainer> container, ContainerHandle handle, PlacementMemo* memo){
+    auto key = [&](const Point<int>& p){
+        return std::make_tuple(container->getLength(), container->getWidth(), container->getHeight(), p.x, p.y, p.z);
+    };
+    std::atomic<int> closest{0};
+    auto note = [&](PlaceResult result){
+        int stage = stageOf(result);
+        int current = closest.load();
+        while(stage > current && !closest.compare_exchange_weak(current, stage)){}
+    };
+    for(const auto& candidate : freeSpace.candidates()){
+        if(memo != nullptr && memo->count(key(candidate))){
+            note(PlaceResult::Collision);
+            continue;
+        }
+        PlaceResult result = placeAt(container, candidate, handle);
+        if(result == PlaceResult::Ok){
+            return result;
+        }
+        note(result);
+        // Containers are only added while a memo is in use, so these failures are final.
+        if(memo != nullptr && (result == PlaceResult::Collision || result == PlaceResult::OutOfBounds)){
+            memo->insert(key(candidate));
         }
     }
-    return false;
+    // Cells are numbered in scan order (Y, then X, then Z) so the parallel search
+    // picks the same slot as a sequential scan would.
+    size_t cells = static_cast<size_t>(length) * width * height;
+    size_t first = findFirst(*pool, cells, static_cast<size_t>(20) * length * height, [&](size_t index){
+        Point<int> cell = cellAt(index);
+        if(memo != nullptr && memo->count(key(cell))){
+            note(PlaceResult::Collision);
+            return false;
+        }
+        PlaceResult result = probe(container, cell.x, cell.y, cell.z);
+        note(result);
+        return result == PlaceResult::Ok;
+    });
+    if (first == cells) {
+        std::cerr << "Container can't add" << std::endl;
+        return PROBE_STAGES[closest.load()];
+    }
+    Point<int> point = cellAt(first);
+    insertContainer(container, point, handle);
+    return PlaceResult::Ok;
 }
 
-std::string Storage::addContainer(std::shared_ptr<IContainer> container){
-    std::vector<std::thread>  threads;
-    Point<int> point;
-    for (int y = 1; y <= width; y += 20) {
-        int yEnd = std::min(y + 20, width);
-        threads.emplace_back(&Storage::addContainerR, this, container, y, yEnd, std::ref(point));
+
+// The manifest is placed in order, each container seeing the ones before it. If any
+// of them fails the placed ones are taken out again and the storage is unchanged;
+// the result still holds the outcome of every container. A manifest with a missing
+// container is rejected before anything is placed.
+std::vector<PlaceResult> Storage::addContainers(std::span<const ManifestItem> manifest){
+    for(const ManifestItem& item : manifest){
+        if(item.container == nullptr){
+            throw std::invalid_argument("Manifest item without a container");
+        }
     }
-    for (auto& t : threads) {
-        t.join();
+    std::vector<PlaceResult> results(manifest.size(), PlaceResult::Ok);
+    Transaction transaction(*this);
+    PlacementMemo memo;
+    bool failed = false;
+    for(size_t i = 0; i < manifest.size(); ++i){
+        const ManifestItem& item = manifest[i];
+        if(item.anchor.has_value()){
+            results[i] = placeAt(item.container, *item.anchor, 0);
+        }else{
+            results[i] = placeAnywhere(item.container, 0, &memo);
+        }
+        if(results[i] != PlaceResult::Ok){
+            failed = true;
+        }
     }
-    if (!containerAdded.load()) {
-        std::cerr << "Container can't add" << std::endl;
-        return "_";
-    } else {
-        containerAdded.store(false);
-        addContainer(container, point.x, point.y, point.z);
-        return container->getId();
+    if(!failed){
+        transaction.commit();
+        publish();
+        return results;
     }
+    // The journal takes the placed containers out again and gives them back their ids.
+    transaction.rollback();
+    return results;
 }
 
 
 void Storage::removeContainer(std::string identification){
-    auto cache = find(identification);
-    Point<int> id = parsePoint(identification);
-    std::vector<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> con = searchUpperContainer(cache.first);
-    if(con.empty()){
-        //Простой случай, если на верху нет 
-        containers.remove(id);
-    }else{
-        //Сложный случай, если на верху есть контейнеры
-        std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>> copy_delete = std::make_pair(cache.first, cache.second->Clone());
-        std::list<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> con_copy;
-        std::list<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> lst;
-        lst.insert(lst.end(), con.begin(), con.end());
-        lst = searchAllContainersUpper(lst);
-        
-        //Удаляем контейнеры, делаем их копии, т.к. они в разных узлах дерева
-
-
-        for(auto& i : lst){
-            if(i.second != nullptr){
-                con_copy.insert(con_copy.begin(), std::make_pair(i.first, i.second->Clone()));
-                containers.remove(i.first.LLDown);
-            }
-        }
+    removeContainer(getHandle(identification));
+}
+
 
-        containers.remove(id);
-        //Пытаемся раскидать контейнеры по новым позициям
+void Storage::removeContainer(ContainerHandle handle){
+    if(support.carried(handle).empty()){
+        //Простой случай, если на верху нет 
+        eraseContainer(find(handle).first);
+        ownedPayloads.erase(handle);
+        publish();
+        return;
+    }
+    //Сложный случай, если на верху есть контейнеры
+    applyRemoval(planRemoval(handle));
+}
 
-        std::vector<std::string> newPlacement;
-        for(auto& container : con_copy){
-            auto last = container.second->Clone();
-            std::string newId = addContainer(last);
 
-            //Возврат, если не получилось раскидать контейнеры
-            if(newId == "_"){
-                last.reset();
-                for(auto& return_containerId : newPlacement){
-                    containers.remove(parsePoint(return_containerId));
-                }
-                    addContainer(copy_delete.second, copy_delete.first.LLDown.x, copy_delete.first.LLDown.y, copy_delete.first.LLDown.z);
-                    for(auto& ret : con_copy){
-                        addContainer(ret.second, ret.first.LLDown.x, ret.first.LLDown.y, ret.first.LLDown.z);
-                    }
-                throw std::invalid_argument("No space found to move container with id " + numeric(id));
-            }
-            //Страховка         
-            
-            else{
-                newPlacement.push_back(newId);
-            }
+// Only containers that would lose their support (or overload what is left of it)
+// are lifted, following the support relation up from the removed one. The plan is
+// worked out on the storage itself inside a transaction that is rolled back, which
+// also brings back the free-space candidates if anything below throws.
+RemovalPlan Storage::planRemoval(ContainerHandle handle){
+    auto target = find(handle);
+    RemovalPlan plan{handle, {}};
+    std::vector<std::shared_ptr<IContainer>> lifted;
+    Transaction transaction(*this);
+    std::vector<ContainerHandle> pending = support.carried(handle);
+    eraseContainer(target.first);
+    for(size_t i = 0; i < pending.size(); ++i){
+        auto anchor = handleAnchors.find(pending[i]);
+        if(anchor == handleAnchors.end()){
+            continue;
+        }
+        auto item = containers.search(anchor->second);
+        if(staysPut(pending[i], item.first)){
+            continue;
+        }
+        // Whatever it carries is checked again once it is lifted.
+        std::vector<ContainerHandle> above = support.carried(pending[i]);
+        pending.insert(pending.end(), above.begin(), above.end());
+        plan.moves.push_back(RemovalMove{pending[i], anchor->second, anchor->second});
+        lifted.push_back(item.second);
+        eraseContainer(item.first);
+    }
+    //Ставим контейнеры по одному, начиная с верхних
+    std::vector<size_t> order(plan.moves.size());
+    for(size_t i = 0; i < order.size(); ++i){
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+        return plan.moves[a].from.z > plan.moves[b].from.z;
+    });
+    std::vector<RemovalMove> moves;
+    for(size_t i : order){
+        std::shared_ptr<IContainer> copy = ownPayload(plan.moves[i].handle, lifted[i]);
+        std::optional<Point<int>> to = relocationTarget(copy);
+        if(!to.has_value()){
+            throw std::invalid_argument("No space found to move container with id " + numeric(target.first.LLDown));
+        }
+        insertContainer(copy, *to, plan.moves[i].handle);
+        plan.moves[i].to = *to;
+        moves.push_back(plan.moves[i]);
+    }
+    plan.moves = std::move(moves);
+    transaction.rollback();
+    return plan;
+}
 
 
+// The plan is checked against the storage as it is now: every moved container must
+// still be where the plan found it, every container left on the removed or moved
+// ones must still stand, and every new place must pass the usual probe.
+void Storage::applyRemoval(const RemovalPlan& plan){
+    Transaction transaction(*this);
+    std::vector<ContainerHandle> resting = support.carried(plan.target);
+    std::vector<std::shared_ptr<IContainer>> lifted;
+    for(const RemovalMove& move : plan.moves){
+        auto item = find(move.handle);
+        if(!(item.first.LLDown == move.from)){
+            throw std::invalid_argument("Removal plan is out of date");
+        }
+        std::vector<ContainerHandle> above = support.carried(move.handle);
+        resting.insert(resting.end(), above.begin(), above.end());
+        lifted.push_back(item.second);
+        eraseContainer(item.first);
+    }
+    eraseContainer(find(plan.target).first);
+    for(ContainerHandle handle : resting){
+        auto anchor = handleAnchors.find(handle);
+        if(anchor != handleAnchors.end() && !staysPut(handle, containers.search(anchor->second).first)){
+            throw std::invalid_argument("Removal plan is out of date: container " + numeric(anchor->second) + " would not stand");
         }
-        //Удаляем копии контейнеров
-        for(auto& i : con_copy){
-            i.second.reset();
+    }
+    for(size_t i = 0; i < plan.moves.size(); ++i){
+        PlaceResult result = placeAt(ownPayload(plan.moves[i].handle, lifted[i]), plan.moves[i].to, plan.moves[i].handle);
+        if(result != PlaceResult::Ok){
+            throw std::invalid_argument("Can't apply removal plan: " + describe(result));
         }
-        copy_delete.second.reset();
     }
+    transaction.commit();
+    ownedPayloads.erase(plan.target);
+    publish();
+}
+
+
+// A container left behind by a removal must still be supported, and every
+// container down its support chains must withstand the weight that shifted onto
+// it. The height map only sees the container itself over its footprint, so the
+// support columns are looked up in the octree.
+bool Storage::staysPut(ContainerHandle handle, const ContainerPosition<Point<int>>& position){
+    BoundingBox<Point<int>> bounds = Octree<Point<int>, std::shared_ptr<IContainer>>::boundsOf(position);
+    int surface = bounds.min.z - 1;
+    auto restsAt = [&](int x, int y){
+        if(surface == 0){
+            return true;
+        }
+        return !containers.queryRange(BoundingBox<Point<int>>(Point<int>(x, y, surface), Point<int>(x, y, surface)),
+            [&](const BoundingBox<Point<int>>& box, const std::shared_ptr<IContainer>&){
+                return box.max.z != surface;
+            });
+    };
+    int midX = bounds.min.x + (bounds.max.x - bounds.min.x) / 2;
+    int midY = bounds.min.y + (bounds.max.y - bounds.min.y) / 2;
+    if(!restsAt(midX, midY) && !(restsAt(bounds.min.x, midY) && restsAt(bounds.max.x, midY))){
+        return false;
+    }
+    return support.holds(handle);
+}
+
+
+// Candidates are probed in parallel. A container set on others buries them, so the
+// candidate resting on the fewest containers wins, then the lowest one, then scan order.
+std::optional<Point<int>> Storage::relocationTarget(std::shared_ptr<IContainer> container){
+    std::vector<Point<int>> candidates = freeSpace.candidates();
+    std::vector<std::pair<size_t, int>> scores(candidates.size(),
+        std::make_pair(std::numeric_limits<size_t>::max(), std::numeric_limits<int>::max()));
+    TaskGroup group(*pool);
+    const size_t chunk = 16;
+    for(size_t start = 0; start < candidates.size(); start += chunk){
+        size_t end = std::min(start + chunk, candidates.size());
+        group.run([&, start, end]{
+            for(size_t i = start; i < end; ++i){
+                const Point<int>& p = candidates[i];
+                if(probe(container, p.x, p.y, p.z) == PlaceResult::Ok){
+                    BoundingBox<Point<int>> bounds = Octree<Point<int>, std::shared_ptr<IContainer>>::calculateBounds(p.x, p.y, p.z, container);
+                    scores[i] = std::make_pair(restingUnder(bounds).size(), p.z);
+                }
+            }
+        });
+    }
+    group.wait();
+    auto best = std::min_element(scores.begin(), scores.end());
+    if(best != scores.end() && best->first != std::numeric_limits<size_t>::max()){
+        return candidates[best - scores.begin()];
+    }
+    size_t cells = static_cast<size_t>(length) * width * height;
+    size_t first = findFirst(*pool, cells, static_cast<size_t>(20) * length * height, [&](size_t index){
+        Point<int> cell = cellAt(index);
+        return probe(container, cell.x, cell.y, cell.z) == PlaceResult::Ok;
+    });
+    if(first == cells){
+        return std::nullopt;
+    }
+    return cellAt(first);
 }
 
 
 std::string Storage::getInfo() const{
     std::string result;
-    auto container = containers.searchDepth();
-    if(container.empty()){
-        return "No containers on storage.";
-    }
-    for(auto& con : container){
-        if(con.second != nullptr){
-            result += con.second->getId() + " " + std::to_string(con.second->getLength()) + " x " +
-        std::to_string(con.second->getWidth()) + " x " + std::to_string(con.second->getHeight()) + " " +
-        con.second->isType() + "\n"; 
+    StorageSnapshot tree = readTree();
+    for(const auto& item : tree->items()){
+        const std::shared_ptr<IContainer>& con = item.second;
+        if(con != nullptr){
+            result += con->getId() + " " + std::to_string(con->getLength()) + " x " +
+        std::to_string(con->getWidth()) + " x " + std::to_string(con->getHeight()) + " " +
+        con->isType() + "\n"; 
         }
     }
+    if(result.empty()){
+        return "No containers on storage.";
+    }
     return result;
 }
 
@@ -457,110 +865,127 @@ void Storage::howContai(std::shared_ptr<IContainer> container, std::vector<size_
 
  size_t Storage::howContainer(std::shared_ptr<IContainer> container){
     std::vector<size_t> result(6, 0);
-    std::vector<std::thread> threads;
+    TaskGroup estimation(*pool);
     for (size_t i = 0; i < 6; ++i) {
-        threads.emplace_back(&Storage::howContai, this, container, std::ref(result), i);
-    }
-    for (auto& t : threads) {
-        t.join();
+        estimation.run([this, container, &result, i]{
+            howContai(container, result, i);
+        });
     }
+    estimation.wait();
     return std::accumulate(result.begin(), result.end(), result[0], [](int a, int b){return std::max(a,b);});
 }
 
 
 std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>> Storage::find(std::string identification){
-    Point<int> id = parsePoint(identification);
-    return containers.search(id);
+    return find(getHandle(identification));
+}
+
+
+std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>> Storage::find(ContainerHandle handle){
+    auto it = handleAnchors.find(handle);
+    if(it == handleAnchors.end()){
+        throw std::invalid_argument("Item not found");
+    }
+    return containers.search(it->second);
+}
+
+
+ContainerHandle Storage::getHandle(const std::string& identification) const{
+    auto it = anchorHandles.find(parsePoint(identification));
+    if(it == anchorHandles.end()){
+        throw std::invalid_argument("Item not found");
+    }
+    return it->second;
 }
 
 
 std::vector<std::string> Storage::getListContainers() const{
     std::vector<std::string> con;
-    auto iterator = containers.cbegin();
-    while(iterator.hasNext()){
-        if((*iterator) != nullptr && !(*iterator)->con.empty()){
-            for(auto it2 = (*iterator)->con.begin(); it2 != (*iterator)->con.end(); ++it2){
-                con.push_back((*it2).second->getId());
-            }
+    StorageSnapshot tree = readTree();
+    for(const auto& item : tree->items()){
+        if(item.second != nullptr){
+            con.push_back(item.second->getId());
         }
-        ++iterator;
     }
     return con;
 }
 
 
-void Storage::checkTemperature(Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> pos){
+PlaceResult Storage::probeTemperature(std::shared_ptr<IContainer> container) const{
     auto ref = std::dynamic_pointer_cast<IRefragedContainer>(container);
     if(ref == nullptr){
-        return;
-    }
-    if(container == nullptr){
-        throw std::invalid_argument("Container is not refraged");
+        return PlaceResult::Ok;
     }
     if(((*container).isType() == "Refraged" || (*container).isType() == "Fragile and Refraged Container") &&
-    storage.temperature > (*ref).getMaxTemperature())
+    temperature > (*ref).getMaxTemperature())
     {
-        throw std::invalid_argument("Container is too hot");
+        return PlaceResult::Temperature;
     }
+    return PlaceResult::Ok;
 }
 
 
-void Storage::checkPressure(Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> pos){
-    if(container == nullptr){
-        throw std::invalid_argument("Container is not fragile");
-    }
+PlaceResult Storage::probePressure(std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> pos){
     if(pos.LLDown.z != 1){
-        std::vector<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> con = storage.searchUnderContainer(pos);
-        if(con.empty() || con[0].first.LLDown.z != 1){
-            throw std::invalid_argument("Container can t fly 1");
-        }
-        if(!checkSupport(pos, con)){
-            throw std::invalid_argument("Support doesn t exist");
-        }
-        for(size_t i = 0; i < con.size(); i++){
-            ContainerPosition<Point<int>> check = con[i].first;
-            if(con[i].second == nullptr){
-                continue;
-            }
-            auto fragileContainer = std::dynamic_pointer_cast<IFragileContainer>(con[i].second);
-            if(fragileContainer == nullptr){
-                continue;
-            }
-            if((fragileContainer->isType() == "Fragile" || fragileContainer->isType() == "Fragile and Refraged Container") && calculatemass(con, i) + (container)->getMass() > fragileContainer->getMaxPressure()){
-                throw std::invalid_argument("Container would be too heavy");
+        BoundingBox<Point<int>> box = Octree<Point<int>, std::shared_ptr<IContainer>>::boundsOf(pos);
+        // Containers above the footprint hide the surface below from the height map.
+        if(heights.highest(box) >= box.min.z){
+            std::vector<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> con = searchUnderContainer(pos);
+            if(con.empty() || con[0].first.LLDown.z != 1 || !checkSupport(pos, con)){
+                return PlaceResult::NoSupport;
             }
+        }else if(!isSupported(box)){
+            return PlaceResult::NoSupport;
+        }
+        if(!support.canCarry(restingUnder(box), container->getMass())){
+            return PlaceResult::Overpressure;
         }
     }
+    return PlaceResult::Ok;
 }
 
 
-std::list<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> Storage::searchAllContainersUpper(std::list<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> lst){
-    for(auto it = lst.begin(); it != lst.end(); it++){
-        auto i = searchUpperContainer(it->first);
-        if(!i.empty()){
-            for(auto it2 = i.begin(); it2 != i.end(); it2++){
-                if(std::find(lst.begin(), lst.end(), *it2) == lst.end()){
-                    lst.push_back(*it2);
-                }
-            }
-        }
+Point<int> Storage::parsePoint(const std::string& str) {
+    Point<int> p(0, 0, 0);
+    if (!tryParsePoint(str, p)) {
+        throw std::invalid_argument("Invalid format for point string");
     }
-    return lst;
+    return p;
 }
 
 
-Point<int> Storage::parsePoint(const std::string& str) {
-    std::regex pattern(R"((\d+|\d+\.\d+)_(\d+|\d+\.\d+)_(\d+|\d+\.\d+))");
-    std::smatch match;
-    if (std::regex_match(str, match, pattern)) {
-        Point<int> point;
-        point.x = static_cast<int>(std::stod(match[1].str()));
-        point.y = static_cast<int>(std::stod(match[2].str()));
-        point.z = static_cast<int>(std::stod(match[3].str()));
-        return point;
-    } else {
-        throw std::invalid_argument("Invalid format for point string");
+bool Storage::tryParsePoint(const std::string& str, Point<int>& p) {
+    // Accepts "X_Y_Z" where every part is digits with an optional fractional tail.
+    int coordinates[3];
+    const char* it = str.data();
+    const char* end = str.data() + str.size();
+    for (int i = 0; i < 3; ++i) {
+        auto [next, error] = std::from_chars(it, end, coordinates[i]);
+        if (error != std::errc() || next == it || *it == '-' || *it == '+') {
+            return false;
+        }
+        it = next;
+        if (it != end && *it == '.') {
+            const char* fraction = ++it;
+            while (it != end && *it >= '0' && *it <= '9') {
+                ++it;
+            }
+            if (it == fraction) {
+                return false;
+            }
+        }
+        if (i < 2) {
+            if (it == end || *it != '_') {
+                return false;
+            }
+            ++it;
+        }
+    }
+    if (it != end) {
+        return false;
     }
+    p = Point<int>(coordinates[0], coordinates[1], coordinates[2]);
+    return true;
 }
 
 
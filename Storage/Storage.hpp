@@ -11,16 +11,110 @@
 #include <iostream>
 #include "../Octree/Octree.hpp"
 #include "../Checker/Checker.hpp"
+#include "ExtremePoints.hpp"
+#include "HeightMap.hpp"
+#include "SupportGraph.hpp"
+#include "MutationJournal.hpp"
+#include "../ThreadPool/ThreadPool.hpp"
 #include <condition_variable>
+#include <unordered_map>
+#include <cstdint>
+#include <span>
+#include <optional>
+#include <set>
+#include <tuple>
+
+/**
+ * @enum PlaceResult
+ * @brief Outcome of probing a position for a container.
+ *
+ * Placement searches use these codes instead of exceptions; the public
+ * throwing API converts anything other than Ok into std::invalid_argument.
+ */
+enum class PlaceResult{
+    Ok,
+    Collision,
+    OutOfBounds,
+    NoSupport,
+    Overpressure,
+    Temperature,
+    Vetoed
+};
+
+/**
+ * @brief Stable identifier of a container inside a storage.
+ *
+ * Unlike the "X_Y_Z" string ID, a handle stays the same when the container is
+ * moved or rotated. Zero is never assigned to a container, and a handle is never
+ * assigned twice, not even after the batch that took it was rolled back.
+ */
+using ContainerHandle = std::uint64_t;
+
+/**
+ * @struct ManifestItem
+ * @brief One container of a loading manifest.
+ *
+ * Without an anchor the storage picks the position like addContainer(container).
+ */
+struct ManifestItem{
+    std::shared_ptr<IContainer> container;
+    std::optional<Point<int>> anchor;
+};
+
+/**
+ * @struct RemovalMove
+ * @brief One container moved out of the way of a removal.
+ */
+struct RemovalMove{
+    ContainerHandle handle;
+    Point<int> from;
+    Point<int> to;
+};
+
+/**
+ * @struct RemovalPlan
+ * @brief Containers to move, in order, before a buried container can be taken out.
+ *
+ * Every moved container is lifted first, then they are set down in order.
+ */
+struct RemovalPlan{
+    ContainerHandle target;
+    std::vector<RemovalMove> moves;
+};
+
+/**
+ * @brief Immutable version of a storage's container octree.
+ *
+ * A snapshot keeps its version alive for as long as it is held; later
+ * placements never change it.
+ */
+using StorageSnapshot = std::shared_ptr<const Octree<Point<int>, std::shared_ptr<IContainer>>>;
 
 
 class Storage{
     private:
+        /// Looseness of the container octree: children accept containers up to half their size across a midplane.
+        static constexpr double LOOSENESS = 2.0;
         int number;
         int length, width, height;
         double temperature;
         Octree<Point<int>, std::shared_ptr<IContainer>> containers;
         Checker<int> checker;
+        ExtremePoints freeSpace;
+        HeightMap heights;
+        SupportGraph support;
+        MutationJournal<std::shared_ptr<IContainer>, Point<int>, ContainerHandle> journal;
+        std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+        std::unordered_map<ContainerHandle, Point<int>> handleAnchors;
+        std::unordered_map<Point<int>, ContainerHandle, PointHash<int>> anchorHandles;
+        ContainerHandle nextHandle = 1;
+        /// Bumped whenever the container objects start being shared with a copy or a snapshot.
+        mutable std::atomic<std::uint64_t> shareEpoch{0};
+        /// Container objects this storage may change in place: the epoch they became private at and the object.
+        std::unordered_map<ContainerHandle, std::pair<std::uint64_t, const IContainer*>> ownedPayloads;
+        std::atomic<bool> snapshotReads{false};
+        StorageSnapshot published;
+        mutable std::mutex publishMtx;
 
         public:
           int getLength() const{
@@ -34,13 +128,14 @@ class Storage{
           }     
           Storage(){}
           std::vector<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> getALLcontainers(){
-            auto i = containers.searchDepth();
+            auto i = readTree()->searchDepth();
             return i;
           }
           void addExternalCheckFunction(const std::function<void(Storage&, std::shared_ptr<IContainer>, ContainerPosition<Point<int>>)>& externalFunc);
           Storage(int number, int length, int width, int height, double temperature);
           Storage(const Storage& other);
           std::string addContainer(std::shared_ptr<IContainer> container);
+          std::vector<PlaceResult> addContainers(std::span<const ManifestItem> manifest);
           void moveContainer(std::string id, int X, int Y, int Z);
           void rotateContainer(std::string id, int method);
           void removeContainer(std::string id);
@@ -49,43 +144,115 @@ class Storage{
             return temperature;
           }
           Octree<Point<int>, std::shared_ptr<IContainer>> getContainer(){
-            return containers;
+            return *readTree();
           }
           size_t howContainer(std::shared_ptr<IContainer> container);
           void addContainer(std::shared_ptr<IContainer>, int X, int Y, int Z);
+          PlaceResult probe(std::shared_ptr<IContainer> container, int X, int Y, int Z);
+          PlaceResult tryPlace(std::shared_ptr<IContainer> container, int X, int Y, int Z);
+          static std::string describe(PlaceResult result);
           void getSize(int l, int w, int h);
           std::string getInfoAboutStorage() const;
+          int restingHeight(std::shared_ptr<IContainer> container, int X, int Y) const;
+          ContainerHandle topAt(int X, int Y) const;
+          double loadOn(ContainerHandle handle) const;
           std::vector<std::string> getListContainers() const;
           ~Storage(){
             }
 
           std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>> find(std::string id);
 
+          ContainerHandle getHandle(const std::string& id) const;
+          std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>> find(ContainerHandle handle);
+          void moveContainer(ContainerHandle handle, int X, int Y, int Z);
+          void rotateContainer(ContainerHandle handle, int method);
+          void removeContainer(ContainerHandle handle);
+          RemovalPlan planRemoval(ContainerHandle handle);
+          void applyRemoval(const RemovalPlan& plan);
+
           Storage& operator=(const Storage& other);
 
+          void enableSnapshotReads(bool enable);
+          bool hasSnapshotReads() const{
+            return snapshotReads.load();
+          }
+          StorageSnapshot snapshot() const;
+
         private:
-          std::mutex mtx;
           mutable std::shared_mutex smtx;
-          std::atomic<bool> containerAdded{false}; 
           int calculateDepth();
           static bool comparePosition(std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>& pos1, std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>& pos2);
           static bool comparePositionReverse(std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>& pos1, std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>& pos2);
           bool isNoTop(const ContainerPosition<Point<int>>& position);
+          bool isSupported(const BoundingBox<Point<int>>& bounds) const;
+          BoundingBox<Point<int>> columnRange(const BoundingBox<Point<int>>& bounds, int zMin, int zMax) const;
           std::vector<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> searchUnderContainer(ContainerPosition<Point<int>>& position);
-          static double calculatemass(std::vector<std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>>> con, size_t it);
-          bool addContainerR(std::shared_ptr<IContainer> container,  int yStart, int yEnd, Point<int>& point);
+          static double pressureLimit(const std::shared_ptr<IContainer>& container);
+          std::vector<ContainerHandle> restingUnder(const BoundingBox<Point<int>>& bounds) const;
+          std::vector<ContainerHandle> restingOn(const BoundingBox<Point<int>>& bounds) const;
+          Point<int> cellAt(size_t index) const;
           bool moveContainer(std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>> it);
           std::pair<ContainerPosition<Point<int>>, std::shared_ptr<IContainer>> isTop(const ContainerPosition<Point<int>>& position);
-           Point<int> multitread(std::shared_ptr<IContainer> container, int X, int Y, int Z);
-           std::vector<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> searchUpperContainer(ContainerPosition<Point<int>>& position);
            void howContai(std::shared_ptr<IContainer> container, std::vector<size_t>& result, size_t method);
            static bool checkSupport(ContainerPosition<Point<int>>& position, std::vector<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> con);
-           static void checkTemperature(Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> position);
-           static void checkPressure(Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> position);
+           PlaceResult probeTemperature(std::shared_ptr<IContainer> container) const;
+           PlaceResult probePressure(std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> position);
+
+           ContainerHandle insertContainer(std::shared_ptr<IContainer> container, const Point<int>& point, ContainerHandle handle = 0);
+           ContainerHandle indexContainer(std::shared_ptr<IContainer> container, const Point<int>& point, ContainerHandle handle);
+           ContainerHandle eraseContainer(const ContainerPosition<Point<int>>& position);
+           PlaceResult placeAt(std::shared_ptr<IContainer> container, const Point<int>& point, ContainerHandle handle);
+           /// Container sizes (l, w, h) and anchors already known to collide or leave the storage.
+           using PlacementMemo = std::set<std::tuple<int, int, int, int, int, int>>;
+           PlaceResult placeAnywhere(std::shared_ptr<IContainer> container, ContainerHandle handle, PlacementMemo* memo = nullptr);
+           bool staysPut(ContainerHandle handle, const ContainerPosition<Point<int>>& position);
+           std::optional<Point<int>> relocationTarget(std::shared_ptr<IContainer> container);
+           void copyContainersFrom(const Storage& other);
+           void shareContainersFrom(const Storage& other);
+           void publish();
+           std::shared_ptr<IContainer> ownPayload(ContainerHandle handle, const std::shared_ptr<IContainer>& container);
+           StorageSnapshot readTree() const;
+           void rollbackTo(size_t mark, size_t spaceMark);
 
-           std::list<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> searchAllContainersUpper(std::list<std::pair<ContainerPosition<Point<int>>,std::shared_ptr<IContainer>>> dec);
+           /**
+            * @brief Journals the insertions and removals made while it lives.
+            *
+            * Unless committed, the changes are undone when it goes out of scope,
+            * so an operation that throws halfway leaves the storage, free-space
+            * candidates included, as it was.
+            */
+           class Transaction{
+               Storage& storage;
+               size_t mark;
+               size_t spaceMark;
+               bool open = true;
+             public:
+               explicit Transaction(Storage& storage)
+                   : storage(storage), mark(storage.journal.begin()), spaceMark(storage.freeSpace.beginLog()) {}
+               Transaction(const Transaction&) = delete;
+               Transaction& operator=(const Transaction&) = delete;
+               void commit(){
+                   if(open){
+                       open = false;
+                       storage.journal.commit();
+                       if(!storage.journal.open()){
+                           storage.freeSpace.endLog();
+                       }
+                   }
+               }
+               void rollback(){
+                   if(open){
+                       open = false;
+                       storage.rollbackTo(mark, spaceMark);
+                   }
+               }
+               ~Transaction(){
+                   rollback();
+               }
+           };
 
-           Point<int> parsePoint(const std::string& str);
+           static Point<int> parsePoint(const std::string& str);
+           static bool tryParsePoint(const std::string& str, Point<int>& p);
            std::string numeric(const Point<int>& p);
 
           
@@ -0,0 +1,198 @@
+#ifndef SUPPORTGRAPH_HPP
+#define SUPPORTGRAPH_HPP
+
+
+#include <vector>
+#include <map>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+/**
+ * @class SupportGraph
+ * @brief Which container rests on which, with the load every container carries.
+ *
+ * Containers are identified by their handles. A container resting on several
+ * others passes its mass plus everything it carries to them in equal shares,
+ * so the load of a container is what the stack above it presses on it. Loads
+ * are updated along the support chains when a container is attached or
+ * detached, and a placement is checked by walking down the chains of the
+ * containers it would rest on.
+ */
+
+class SupportGraph{
+    private:
+        struct Node{
+            int base = 0;
+            double mass = 0;
+            double capacity = std::numeric_limits<double>::infinity();
+            double load = 0;
+            std::vector<std::uint64_t> below;
+            std::vector<std::uint64_t> above;
+        };
+        std::unordered_map<std::uint64_t, Node> nodes;
+
+        // Hands deltas down the support chains, highest containers first, so every
+        // container is visited once with the sum of what reaches it. The visitor
+        // returns false to stop.
+        template<typename Visit>
+        bool spread(const std::vector<std::uint64_t>& targets, double amount, Visit&& visit) const{
+            if(targets.empty()){
+                return true;
+            }
+            std::map<std::pair<int, std::uint64_t>, double, std::greater<>> frontier;
+            for(std::uint64_t target : targets){
+                auto it = nodes.find(target);
+                if(it != nodes.end()){
+                    frontier[{it->second.base, target}] += amount / targets.size();
+                }
+            }
+            while(!frontier.empty()){
+                auto [key, delta] = *frontier.begin();
+                frontier.erase(frontier.begin());
+                const Node& node = nodes.at(key.second);
+                if(!visit(key.second, delta)){
+                    return false;
+                }
+                for(std::uint64_t next : node.below){
+                    auto it = nodes.find(next);
+                    if(it != nodes.end()){
+                        frontier[{it->second.base, next}] += delta / node.below.size();
+                    }
+                }
+            }
+            return true;
+        }
+
+        void addLoad(const std::vector<std::uint64_t>& targets, double amount){
+            spread(targets, amount, [&](std::uint64_t handle, double delta){
+                nodes.at(handle).load += delta;
+                return true;
+            });
+        }
+
+        static void erase(std::vector<std::uint64_t>& list, std::uint64_t handle){
+            list.erase(std::remove(list.begin(), list.end(), handle), list.end());
+        }
+
+    public:
+        SupportGraph(){}
+
+        /**
+         * @brief Add a placed container.
+         * @param handle Handle of the container.
+         * @param base Z of the container's bottom.
+         * @param mass Mass of the container.
+         * @param capacity Load the container withstands, infinity if it is not fragile.
+         * @param below Containers it rests on.
+         * @param above Containers already resting on it.
+         */
+        void attach(std::uint64_t handle, int base, double mass, double capacity,
+                    const std::vector<std::uint64_t>& below, const std::vector<std::uint64_t>& above){
+            Node& node = nodes[handle];
+            node = Node{base, mass, capacity, 0, below, {}};
+            for(std::uint64_t b : below){
+                nodes.at(b).above.push_back(handle);
+            }
+            addLoad(below, mass);
+            for(std::uint64_t a : above){
+                // The container above now shares its weight with the new one too.
+                Node& upper = nodes.at(a);
+                double weight = upper.mass + upper.load;
+                addLoad(upper.below, -weight);
+                upper.below.push_back(handle);
+                nodes.at(handle).above.push_back(a);
+                addLoad(nodes.at(a).below, weight);
+            }
+        }
+
+        /**
+         * @brief Remove a container, moving the weight of anything on it to its other supports.
+         * @param handle Handle of the container.
+         */
+        void detach(std::uint64_t handle){
+            auto it = nodes.find(handle);
+            if(it == nodes.end()){
+                return;
+            }
+            std::vector<std::uint64_t> above = it->second.above;
+            for(std::uint64_t a : above){
+                Node& upper = nodes.at(a);
+                double weight = upper.mass + upper.load;
+                addLoad(upper.below, -weight);
+                erase(upper.below, handle);
+                addLoad(nodes.at(a).below, weight);
+            }
+            Node& node = nodes.at(handle);
+            addLoad(node.below, -(node.mass + node.load));
+            for(std::uint64_t b : node.below){
+                erase(nodes.at(b).above, handle);
+            }
+            nodes.erase(handle);
+        }
+
+        /**
+         * @brief Check that a new container would not overload anything under it.
+         * @param below Containers it would rest on.
+         * @param mass Mass of the new container.
+         * @return True if every container down the chains withstands its new load.
+         */
+        bool canCarry(const std::vector<std::uint64_t>& below, double mass) const{
+            return spread(below, mass, [&](std::uint64_t handle, double delta){
+                const Node& node = nodes.at(handle);
+                return node.load + delta <= node.capacity;
+            });
+        }
+
+        /**
+         * @brief Check the containers a container rests on, all the way down.
+         * @param handle Handle of the container.
+         * @return True if every container down its support chains withstands its current load.
+         */
+        bool holds(std::uint64_t handle) const{
+            auto it = nodes.find(handle);
+            if(it == nodes.end()){
+                return true;
+            }
+            return spread(it->second.below, 0, [&](std::uint64_t below, double){
+                const Node& node = nodes.at(below);
+                return node.load <= node.capacity;
+            });
+        }
+
+        /**
+         * @brief Get the load resting on a container.
+         * @return Mass pressing on the container, 0 for unknown handles.
+         */
+        double load(std::uint64_t handle) const{
+            auto it = nodes.find(handle);
+            return it == nodes.end() ? 0 : it->second.load;
+        }
+
+        /**
+         * @brief Get the containers a container rests on.
+         * @return Handles, empty for the floor or unknown handles.
+         */
+        std::vector<std::uint64_t> supports(std::uint64_t handle) const{
+            auto it = nodes.find(handle);
+            return it == nodes.end() ? std::vector<std::uint64_t>() : it->second.below;
+        }
+
+        /**
+         * @brief Get the containers resting on a container.
+         * @return Handles, empty if nothing rests on it.
+         */
+        std::vector<std::uint64_t> carried(std::uint64_t handle) const{
+            auto it = nodes.find(handle);
+            return it == nodes.end() ? std::vector<std::uint64_t>() : it->second.above;
+        }
+
+        size_t size() const{
+            return nodes.size();
+        }
+};
+
+
+#endif
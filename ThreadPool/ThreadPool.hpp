@@ -0,0 +1,321 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <exception>
+#include <condition_variable>
+
+/**
+ * @class ThreadPool
+ * @brief A fixed set of worker threads with per-worker queues and work stealing.
+ *
+ * Each worker pops tasks from the back of its own queue and steals from the
+ * front of the others when it runs dry. Tasks submitted from outside the pool
+ * are spread over the queues round-robin. Threads that wait for a TaskGroup
+ * keep executing queued tasks, so tasks may safely wait for nested tasks.
+ */
+
+class ThreadPool{
+    private:
+        struct Queue{
+            std::mutex mtx;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex sleepMtx;
+        std::condition_variable wake;
+        std::atomic<size_t> queued{0};
+        std::atomic<size_t> nextQueue{0};
+        bool stopping = false;
+
+        static size_t& workerIndex(){
+            thread_local size_t index = static_cast<size_t>(-1);
+            return index;
+        }
+
+        static const ThreadPool*& workerPool(){
+            thread_local const ThreadPool* pool = nullptr;
+            return pool;
+        }
+
+        bool popTask(std::function<void()>& task){
+            if(queued.load() == 0){
+                return false;
+            }
+            size_t count = queues.size();
+            size_t self = isWorker() ? workerIndex() : nextQueue.load() % count;
+            if(isWorker()){
+                std::lock_guard<std::mutex> lock(queues[self]->mtx);
+                if(!queues[self]->tasks.empty()){
+                    task = std::move(queues[self]->tasks.back());
+                    queues[self]->tasks.pop_back();
+                    --queued;
+                    return true;
+                }
+            }
+            for(size_t i = 0; i < count; ++i){
+                Queue& victim = *queues[(self + i) % count];
+                std::lock_guard<std::mutex> lock(victim.mtx);
+                if(!victim.tasks.empty()){
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    --queued;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void workerLoop(size_t index){
+            workerIndex() = index;
+            workerPool() = this;
+            while(true){
+                std::function<void()> task;
+                if(popTask(task)){
+                    task();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleepMtx);
+                wake.wait(lock, [this]{ return stopping || queued.load() > 0; });
+                if(stopping && queued.load() == 0){
+                    return;
+                }
+            }
+        }
+
+    public:
+        /**
+         * @brief Start the workers.
+         * @param threads Number of worker threads, at least one.
+         */
+        explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()){
+            if(threads == 0){
+                threads = 1;
+            }
+            for(size_t i = 0; i < threads; ++i){
+                queues.push_back(std::make_unique<Queue>());
+            }
+            for(size_t i = 0; i < threads; ++i){
+                workers.emplace_back(&ThreadPool::workerLoop, this, i);
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool(){
+            {
+                std::lock_guard<std::mutex> lock(sleepMtx);
+                stopping = true;
+            }
+            wake.notify_all();
+            for(auto& worker : workers){
+                worker.join();
+            }
+        }
+
+        /**
+         * @brief Get the pool shared by all storages of the process.
+         * @return Shared pointer to a pool sized to the hardware concurrency.
+         */
+        static std::shared_ptr<ThreadPool> shared(){
+            static std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>();
+            return pool;
+        }
+
+        size_t size() const{
+            return workers.size();
+        }
+
+        /**
+         * @brief Check whether the calling thread is one of this pool's workers.
+         * @return True on a worker of this pool, otherwise false.
+         */
+        bool isWorker() const{
+            return workerPool() == this;
+        }
+
+        /**
+         * @brief Queue a task for execution.
+         *
+         * Tasks submitted from a worker go to that worker's own queue.
+         *
+         * @param task Callable to execute.
+         */
+        void submit(std::function<void()> task){
+            size_t index = isWorker() ? workerIndex() : nextQueue++ % queues.size();
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->mtx);
+                queues[index]->tasks.push_back(std::move(task));
+                ++queued;
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleepMtx);
+            }
+            wake.notify_one();
+        }
+
+        /**
+         * @brief Execute one queued task on the calling thread, if there is any.
+         * @return True if a task was executed, otherwise false.
+         */
+        bool runPendingTask(){
+            std::function<void()> task;
+            if(!popTask(task)){
+                return false;
+            }
+            task();
+            return true;
+        }
+};
+
+/**
+ * @class TaskGroup
+ * @brief A set of tasks submitted to a ThreadPool that can be waited for and cancelled.
+ *
+ * Cancellation is cooperative: tasks poll isCancelled() and return early.
+ * The first exception thrown by a task is rethrown from wait().
+ */
+
+class TaskGroup{
+    private:
+        ThreadPool& pool;
+        std::atomic<size_t> pending{0};
+        std::atomic<bool> cancelled{false};
+        std::mutex errorMtx;
+        std::exception_ptr error;
+        std::mutex doneMtx;
+        std::condition_variable done;
+
+        void helpUntilDone(){
+            while(pending.load() > 0){
+                if(!pool.runPendingTask()){
+                    std::unique_lock<std::mutex> lock(doneMtx);
+                    done.wait_for(lock, std::chrono::milliseconds(1), [this]{ return pending.load() == 0; });
+                }
+            }
+            // The last task still holds doneMtx while it signals completion.
+            std::lock_guard<std::mutex> lock(doneMtx);
+        }
+
+    public:
+        explicit TaskGroup(ThreadPool& pool) : pool(pool) {}
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        ~TaskGroup(){
+            cancel();
+            helpUntilDone();
+        }
+
+        /**
+         * @brief Submit a task belonging to this group.
+         * @param task Callable to execute.
+         */
+        template<typename F>
+        void run(F&& task){
+            ++pending;
+            pool.submit([this, task = std::forward<F>(task)]() mutable {
+                try{
+                    task();
+                }catch(...){
+                    std::lock_guard<std::mutex> lock(errorMtx);
+                    if(!error){
+                        error = std::current_exception();
+                    }
+                }
+                std::lock_guard<std::mutex> lock(doneMtx);
+                if(--pending == 0){
+                    done.notify_all();
+                }
+            });
+        }
+
+        /**
+         * @brief Wait for all tasks of the group, running queued tasks meanwhile.
+         * @throws Any exception thrown by one of the tasks.
+         */
+        void wait(){
+            helpUntilDone();
+            if(error){
+                std::rethrow_exception(error);
+            }
+        }
+
+        void cancel(){
+            cancelled.store(true);
+        }
+
+        /**
+         * @brief Cancel the group unless it is already cancelled.
+         * @return True if this call cancelled the group, otherwise false.
+         */
+        bool claim(){
+            return !cancelled.exchange(true);
+        }
+
+        bool isCancelled() const{
+            return cancelled.load();
+        }
+};
+
+/**
+ * @brief Find the lowest index satisfying a predicate, searching chunks in parallel.
+ *
+ * The result is the same as a sequential scan: chunks publish hits through an
+ * atomic minimum and stop as soon as they reach an index at or above the best
+ * hit found so far, so chunks after the winner are abandoned early. Called
+ * from a worker of the pool the scan runs inline, so a task that is already
+ * parallel with its siblings does not queue a search behind them.
+ *
+ * @param pool Pool executing the chunks.
+ * @param count Number of indices to search.
+ * @param chunk Number of consecutive indices per task.
+ * @param predicate Thread-safe callable taking an index and returning bool.
+ * @return The lowest matching index, or count if none matches.
+ */
+template<typename Predicate>
+size_t findFirst(ThreadPool& pool, size_t count, size_t chunk, Predicate&& predicate){
+    std::atomic<size_t> best{count};
+    if(chunk == 0){
+        chunk = 1;
+    }
+    if(pool.isWorker()){
+        for(size_t i = 0; i < count; ++i){
+            if(predicate(i)){
+                return i;
+            }
+        }
+        return count;
+    }
+    TaskGroup search(pool);
+    for(size_t start = 0; start < count; start += chunk){
+        size_t end = std::min(start + chunk, count);
+        search.run([&best, &predicate, start, end]{
+            for(size_t i = start; i < end && i < best.load(); ++i){
+                if(predicate(i)){
+                    size_t current = best.load();
+                    while(i < current && !best.compare_exchange_weak(current, i)){}
+                    return;
+                }
+            }
+        });
+    }
+    search.wait();
+    return best.load();
+}
+
+
+#endif
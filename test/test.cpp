@@ -5,6 +5,12 @@
 #include "../Container/FragileContainer.hpp"
 #include "../Container/RefragedContainer.hpp"
 #include "../Container/Frag_and_Ref.hpp"
+#include "../ThreadPool/ThreadPool.hpp"
+#include "../Octree/OverlapKernel.hpp"
+#include "../Octree/LinearOctree.hpp"
+#include "../Octree/ConcurrentOctree.hpp"
+#include <random>
+#include <future>
 
 
 TEST(StorageTests, Initialization) {
@@ -212,6 +218,288 @@ TEST(StorageTest, Remove){
 }
 
 
+TEST(StorageTest, AutoPlacementFreeSpace){
+    Storage storage(1, 10, 5, 3, 20.0);
+    std::vector<std::string> ids;
+    for(int i = 0; i < 4; ++i){
+        ids.push_back(storage.addContainer(std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5)));
+    }
+    EXPECT_EQ(ids, (std::vector<std::string>{"1_1_1", "3_1_1", "5_1_1", "7_1_1"}));
+    storage.removeContainer("3_1_1");
+    EXPECT_EQ(storage.addContainer(std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5)), "3_1_1");
+}
+
+TEST(StorageTest, ProbeResults){
+    Storage storage(1, 20, 20, 10, 20.0);
+    storage.addContainer(std::make_shared<FragileContainer>("_", "Cargo B", 4, 4, 1, 23.5, 2.5, 3.0), 1, 1, 1);
+    EXPECT_EQ(storage.probe(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 1.0, 1.0), 2, 2, 1), PlaceResult::Collision);
+    EXPECT_EQ(storage.probe(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 1.0, 1.0), 19, 1, 1), PlaceResult::OutOfBounds);
+    EXPECT_EQ(storage.probe(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 1.0, 1.0), 10, 10, 3), PlaceResult::NoSupport);
+    EXPECT_EQ(storage.probe(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 1.0, 5.0), 2, 2, 3), PlaceResult::Overpressure);
+    EXPECT_EQ(storage.probe(std::make_shared<RefragedContainer>("_", "Cargo C", 1, 1, 1, 1.0, 1.0, 10.0), 10, 10, 1), PlaceResult::Temperature);
+    EXPECT_EQ(storage.tryPlace(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 1.0, 1.0), 2, 2, 3), PlaceResult::Ok);
+    EXPECT_NO_THROW(storage.find("2_2_3"));
+}
+
+TEST(StorageTest, Handles){
+    Storage storage(1, 20, 20, 10, 20.0);
+    storage.addContainer(std::make_shared<Container>("_", "Cargo A", 2, 2, 1, 1.0, 1.0), 1, 1, 1);
+    ContainerHandle handle = storage.getHandle("1_1_1");
+    EXPECT_NE(handle, 0u);
+    EXPECT_EQ(storage.find(handle).second, storage.find("1_1_1").second);
+    storage.moveContainer(handle, 5, 5, 1);
+    EXPECT_EQ(storage.getHandle("5_5_1"), handle);
+    EXPECT_THROW(storage.getHandle("1_1_1"), std::invalid_argument);
+    storage.rotateContainer("5_5_1", 1);
+    EXPECT_EQ(storage.find(handle).first.LLDown.x, 5);
+    Storage copy(storage);
+    EXPECT_EQ(copy.getHandle("5_5_1"), handle);
+    EXPECT_THROW(storage.getHandle("5_5"), std::invalid_argument);
+    storage.removeContainer(handle);
+    EXPECT_THROW(storage.find(handle), std::invalid_argument);
+}
+
+TEST(StorageTest, CopiesDoNotShareChanges){
+    Storage storage(1, 20, 20, 10, 20.0);
+    storage.addContainer(std::make_shared<Container>("_", "Cargo A", 2, 2, 1, 1.0, 1.0), 1, 1, 1);
+    Storage copy(storage);
+    copy.moveContainer("1_1_1", 5, 5, 1);
+    copy.addContainer(std::make_shared<Container>("_", "Cargo B", 2, 2, 1, 1.0, 1.0), 10, 10, 1);
+    EXPECT_EQ(storage.find("1_1_1").second->getId(), "1_1_1");
+    EXPECT_THROW(storage.find("5_5_1"), std::invalid_argument);
+    EXPECT_THROW(storage.find("10_10_1"), std::invalid_argument);
+    EXPECT_EQ(copy.find("5_5_1").second->getId(), "5_5_1");
+    EXPECT_EQ(storage.getListContainers().size(), 1);
+    EXPECT_EQ(copy.getListContainers().size(), 2);
+}
+
+TEST(StorageTest, SnapshotReads){
+    Storage storage(1, 40, 40, 4, 20.0);
+    storage.enableSnapshotReads(true);
+    storage.addContainer(std::make_shared<Container>("_", "Cargo A", 2, 2, 1, 1.0, 1.0), 1, 1, 1);
+    StorageSnapshot pinned = storage.snapshot();
+    storage.addContainer(std::make_shared<Container>("_", "Cargo B", 2, 2, 1, 1.0, 1.0), 10, 10, 1);
+    storage.moveContainer("1_1_1", 20, 20, 1);
+    EXPECT_EQ(pinned->searchDepth().size(), 1);
+    EXPECT_EQ(pinned->search(Point<int>(1, 1, 1)).second->getId(), "1_1_1");
+    EXPECT_EQ(storage.getListContainers().size(), 2);
+    EXPECT_EQ(storage.snapshot()->search(Point<int>(20, 20, 1)).second->getId(), "20_20_1");
+
+    std::atomic<bool> done{false};
+    std::thread reader([&]{
+        while(!done.load()){
+            size_t seen = storage.getALLcontainers().size();
+            EXPECT_GE(seen, 2);
+            EXPECT_EQ(storage.getListContainers().size() >= seen, true);
+        }
+    });
+    for(int i = 0; i < 30; ++i){
+        storage.addContainer(std::make_shared<Container>("_", "Cargo", 1, 1, 1, 1.0, 1.0));
+    }
+    done.store(true);
+    reader.join();
+    EXPECT_EQ(storage.getListContainers().size(), 32);
+}
+
+TEST(StorageTest, HeightMap){
+    Storage storage(1, 20, 20, 10, 20.0);
+    auto cargo = [](int l, int w){
+        return std::make_shared<Container>("_", "Cargo", l, w, 1, 1.0, 1.0);
+    };
+    EXPECT_EQ(storage.restingHeight(cargo(2, 2), 1, 1), 1);
+    storage.addContainer(cargo(2, 2), 1, 1, 1);
+    ContainerHandle bottom = storage.getHandle("1_1_1");
+    EXPECT_EQ(storage.topAt(2, 2), bottom);
+    EXPECT_EQ(storage.topAt(4, 4), 0);
+    EXPECT_EQ(storage.restingHeight(cargo(2, 2), 1, 1), 3);
+    EXPECT_EQ(storage.tryPlace(cargo(2, 2), 10, 10, 3), PlaceResult::NoSupport);
+    storage.addContainer(cargo(2, 2), 1, 1, 3);
+    EXPECT_EQ(storage.topAt(2, 2), storage.getHandle("1_1_3"));
+    EXPECT_THROW(storage.moveContainer("1_1_1", 10, 10, 1), std::invalid_argument);
+    storage.removeContainer("1_1_3");
+    EXPECT_EQ(storage.topAt(2, 2), bottom);
+    EXPECT_EQ(storage.restingHeight(cargo(2, 2), 1, 1), 3);
+    // A bridge whose middle hangs over a gap rests on both of its ends.
+    storage.addContainer(cargo(1, 2), 10, 1, 1);
+    storage.addContainer(cargo(1, 2), 14, 1, 1);
+    EXPECT_EQ(storage.tryPlace(cargo(5, 2), 10, 1, 3), PlaceResult::Ok);
+    EXPECT_EQ(storage.topAt(12, 2), storage.getHandle("10_1_3"));
+    EXPECT_EQ(storage.tryPlace(cargo(5, 2), 11, 5, 3), PlaceResult::NoSupport);
+}
+
+TEST(StorageTest, SupportGraphLoads){
+    Storage storage(1, 20, 20, 10, 20.0);
+    storage.addContainer(std::make_shared<FragileContainer>("_", "Cargo F", 2, 2, 1, 23.5, 1.0, 3.0), 1, 1, 1);
+    storage.addContainer(std::make_shared<Container>("_", "Cargo S", 2, 2, 1, 1.0, 10.0), 5, 1, 1);
+    ContainerHandle fragile = storage.getHandle("1_1_1");
+    ContainerHandle sturdy = storage.getHandle("5_1_1");
+    // The bridge rests on both, so the fragile one carries half of it and nothing of its neighbour.
+    storage.addContainer(std::make_shared<Container>("_", "Bridge", 6, 2, 1, 1.0, 4.0), 1, 1, 3);
+    EXPECT_DOUBLE_EQ(storage.loadOn(fragile), 2.0);
+    EXPECT_DOUBLE_EQ(storage.loadOn(sturdy), 2.0);
+    EXPECT_EQ(storage.probe(std::make_shared<Container>("_", "Top", 2, 2, 1, 1.0, 1.0), 3, 1, 5), PlaceResult::Ok);
+    EXPECT_EQ(storage.probe(std::make_shared<Container>("_", "Top", 2, 2, 1, 1.0, 3.0), 3, 1, 5), PlaceResult::Overpressure);
+    storage.addContainer(std::make_shared<Container>("_", "Top", 2, 2, 1, 1.0, 2.0), 3, 1, 5);
+    EXPECT_DOUBLE_EQ(storage.loadOn(storage.getHandle("1_1_3")), 2.0);
+    EXPECT_DOUBLE_EQ(storage.loadOn(fragile), 3.0);
+    storage.removeContainer("3_1_5");
+    EXPECT_DOUBLE_EQ(storage.loadOn(fragile), 2.0);
+    storage.removeContainer("1_1_3");
+    EXPECT_DOUBLE_EQ(storage.loadOn(fragile), 0.0);
+    EXPECT_DOUBLE_EQ(storage.loadOn(sturdy), 0.0);
+}
+
+TEST(StorageTest, AddContainersBatch){
+    Storage storage(1, 20, 20, 10, 20.0);
+    storage.enableSnapshotReads(true);
+    storage.addContainer(std::make_shared<Container>("_", "Cargo A", 2, 2, 1, 1.0, 1.0), 10, 10, 1);
+    std::vector<ManifestItem> manifest;
+    for(int i = 0; i < 20; ++i){
+        manifest.push_back(ManifestItem{std::make_shared<Container>("_", "Cargo", 2, 2, 1, 1.0, 1.0), std::nullopt});
+    }
+    manifest.push_back(ManifestItem{std::make_shared<Container>("_", "Cargo", 2, 2, 1, 1.0, 1.0), Point<int>(11, 11, 1)});
+    manifest.push_back(ManifestItem{std::make_shared<Container>("_", "Cargo", 2, 2, 1, 1.0, 1.0), Point<int>(15, 15, 5)});
+    manifest.push_back(ManifestItem{std::make_shared<RefragedContainer>("_", "Cargo C", 1, 1, 1, 1.0, 1.0, 10.0), std::nullopt});
+    std::vector<PlaceResult> results = storage.addContainers(manifest);
+    ASSERT_EQ(results.size(), manifest.size());
+    EXPECT_EQ(std::count(results.begin(), results.end(), PlaceResult::Ok), 20);
+    EXPECT_EQ(results[20], PlaceResult::Collision);
+    EXPECT_EQ(results[21], PlaceResult::NoSupport);
+    // An automatic placement reports why it failed, not just that no slot was found.
+    EXPECT_EQ(results[22], PlaceResult::Temperature);
+    // Nothing of the failed manifest stays behind.
+    EXPECT_EQ(storage.getListContainers().size(), 1);
+    EXPECT_EQ(storage.getALLcontainers().size(), 1);
+    EXPECT_EQ(manifest[0].container->getId(), "_");
+    manifest.pop_back();
+    manifest.pop_back();
+    manifest.pop_back();
+    results = storage.addContainers(manifest);
+    EXPECT_EQ(std::count(results.begin(), results.end(), PlaceResult::Ok), 20);
+    EXPECT_EQ(storage.getListContainers().size(), 21);
+    // The handles taken by the rolled back batch are not handed out again.
+    EXPECT_EQ(storage.getHandle(manifest[0].container->getId()), 22);
+    EXPECT_NE(storage.addContainer(std::make_shared<Container>("_", "Cargo", 2, 2, 1, 1.0, 1.0)), "_");
+    manifest.push_back(ManifestItem{nullptr, std::nullopt});
+    EXPECT_THROW(storage.addContainers(manifest), std::invalid_argument);
+    EXPECT_EQ(storage.getListContainers().size(), 22);
+}
+
+TEST(StorageTest, MutationJournal){
+    Storage st(2, 12, 3, 5, 20.0);
+    st.addContainer(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 21.2, 1.1), 1, 1, 1);
+    st.addContainer(std::make_shared<Container>("_", "Cargo A", 8, 1, 1, 21.2, 1.1), 3, 1, 1);
+    std::shared_ptr<IContainer> top = std::make_shared<Container>("_", "Cargo A", 10, 1, 1, 21.2, 1.1);
+    st.addContainer(top, 1, 1, 3);
+    ContainerHandle base = st.getHandle("3_1_1");
+    ContainerHandle upper = st.getHandle("1_1_3");
+    double load = st.loadOn(base);
+    std::vector<std::string> before = st.getListContainers();
+    std::sort(before.begin(), before.end());
+    // The cascade finds no room for the top container and is undone.
+    EXPECT_THROW(st.removeContainer(base), std::invalid_argument);
+    std::vector<std::string> after = st.getListContainers();
+    std::sort(after.begin(), after.end());
+    EXPECT_EQ(after, before);
+    EXPECT_EQ(st.find(upper).second, top);
+    EXPECT_EQ(top->getId(), "1_1_3");
+    EXPECT_EQ(st.getHandle("3_1_1"), base);
+    EXPECT_DOUBLE_EQ(st.loadOn(base), load);
+    // A failed move puts back the same container object.
+    EXPECT_THROW(st.moveContainer(upper, 5, 2, 1), std::invalid_argument);
+    EXPECT_EQ(st.find(upper).second, top);
+    EXPECT_EQ(st.topAt(5, 1), upper);
+    EXPECT_NO_THROW(st.removeContainer(upper));
+    EXPECT_NO_THROW(st.removeContainer(base));
+    EXPECT_EQ(st.getListContainers().size(), 1);
+    // Free-space candidates come back exactly, including the ones a placement covered.
+    ExtremePoints space(BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(10, 10, 10)));
+    space.occupy(BoundingBox<Point<int>>(Point<int>(1, 1, 1), Point<int>(3, 3, 2)));
+    std::vector<Point<int>> candidates = space.candidates();
+    size_t mark = space.beginLog();
+    space.occupy(BoundingBox<Point<int>>(Point<int>(4, 1, 1), Point<int>(9, 6, 2)));
+    space.release(BoundingBox<Point<int>>(Point<int>(1, 1, 1), Point<int>(3, 3, 2)));
+    EXPECT_NE(space.candidates(), candidates);
+    space.undo(mark);
+    space.endLog();
+    EXPECT_EQ(space.candidates(), candidates);
+}
+
+TEST(StorageTest, RemovalPlan){
+    Storage st(1, 20, 5, 8, 20.0);
+    st.addContainer(std::make_shared<Container>("_", "Cargo A", 4, 2, 1, 21.2, 1.1), 1, 1, 1);
+    st.addContainer(std::make_shared<Container>("_", "Cargo A", 4, 2, 1, 21.2, 1.1), 6, 1, 1);
+    // Rests on both bottom containers but is held by the second one alone.
+    st.addContainer(std::make_shared<Container>("_", "Cargo A", 4, 2, 1, 21.2, 1.1), 4, 1, 3);
+    st.addContainer(std::make_shared<Container>("_", "Cargo A", 2, 2, 1, 21.2, 1.1), 1, 1, 3);
+    st.addContainer(std::make_shared<Container>("_", "Cargo A", 2, 2, 1, 21.2, 1.1), 1, 1, 5);
+    ContainerHandle target = st.getHandle("1_1_1");
+    ContainerHandle bridge = st.getHandle("4_1_3");
+    std::vector<std::string> before = st.getListContainers();
+    std::sort(before.begin(), before.end());
+    RemovalPlan plan = st.planRemoval(target);
+    std::vector<std::string> after = st.getListContainers();
+    std::sort(after.begin(), after.end());
+    EXPECT_EQ(after, before);
+    ASSERT_EQ(plan.moves.size(), 2);
+    // The upper container is lifted first, nothing is set on top of another container.
+    EXPECT_EQ(plan.moves[0].handle, st.getHandle("1_1_5"));
+    EXPECT_EQ(plan.moves[1].handle, st.getHandle("1_1_3"));
+    for(const RemovalMove& move : plan.moves){
+        EXPECT_NE(move.handle, bridge);
+        EXPECT_EQ(move.to.z, 1);
+    }
+    st.applyRemoval(plan);
+    EXPECT_THROW(st.find(target), std::invalid_argument);
+    EXPECT_EQ(st.getHandle("4_1_3"), bridge);
+    EXPECT_EQ(st.getListContainers().size(), 4);
+    EXPECT_EQ(st.find(plan.moves[0].handle).first.LLDown, plan.moves[0].to);
+    // A plan made for another state is refused.
+    EXPECT_THROW(st.applyRemoval(plan), std::invalid_argument);
+
+    // The bridge would stand on the sturdy container alone, but its weight would
+    // then crush the fragile one under it, so it has to move.
+    Storage chain(1, 30, 6, 10, 20.0);
+    chain.addContainer(std::make_shared<FragileContainer>("_", "Cargo F", 4, 2, 1, 1.0, 1.0, 4.0), 1, 1, 1);
+    chain.addContainer(std::make_shared<Container>("_", "Cargo S", 4, 2, 1, 1.0, 1.0), 1, 1, 3);
+    chain.addContainer(std::make_shared<Container>("_", "Cargo T", 4, 2, 3, 1.0, 1.0), 6, 1, 1);
+    chain.addContainer(std::make_shared<Container>("_", "Bridge", 4, 2, 1, 1.0, 4.0), 3, 1, 5);
+    ContainerHandle fragile = chain.getHandle("1_1_1");
+    plan = chain.planRemoval(chain.getHandle("6_1_1"));
+    ASSERT_EQ(plan.moves.size(), 1);
+    EXPECT_EQ(plan.moves[0].handle, chain.getHandle("3_1_5"));
+    // Applied without its move, the plan would leave the bridge on the fragile stack.
+    RemovalPlan partial{plan.target, {}};
+    EXPECT_THROW(chain.applyRemoval(partial), std::invalid_argument);
+    EXPECT_EQ(chain.getListContainers().size(), 4);
+    chain.applyRemoval(plan);
+    EXPECT_LE(chain.loadOn(fragile), 4.0);
+}
+
+TEST(StorageTest, PayloadIsolation){
+    Storage st(1, 20, 10, 5, 20.0);
+    std::shared_ptr<IContainer> box = std::make_shared<Container>("_", "Cargo A", 2, 2, 1, 21.2, 1.1);
+    st.addContainer(box, 1, 1, 1);
+    ContainerHandle handle = st.getHandle("1_1_1");
+    // Nothing else holds the storage's containers, so a move keeps the caller's object.
+    st.moveContainer(handle, 5, 1, 1);
+    EXPECT_EQ(st.find(handle).second, box);
+    EXPECT_EQ(box->getId(), "5_1_1");
+    Storage copy = st;
+    st.moveContainer(handle, 9, 1, 1);
+    std::shared_ptr<IContainer> moved = st.find(handle).second;
+    EXPECT_NE(moved, box);
+    EXPECT_EQ(moved->getId(), "9_1_1");
+    // The copy still sees the container where it was.
+    EXPECT_EQ(copy.find(handle).second, box);
+    EXPECT_EQ(box->getId(), "5_1_1");
+    st.moveContainer(handle, 13, 1, 1);
+    EXPECT_EQ(st.find(handle).second, moved);
+    copy.moveContainer(handle, 1, 5, 1);
+    EXPECT_EQ(copy.find(handle).second->getId(), "1_5_1");
+    EXPECT_EQ(moved->getId(), "13_1_1");
+}
+
 void checkCheker(Storage& storage, std::shared_ptr<IContainer> container, ContainerPosition<Point<int>> pos){
     if(((*container).isType() == "Fragile and Refraged Container" ))
     {
@@ -371,6 +659,57 @@ TEST(OctreeTest, TestIterator){
     EXPECT_EQ(it.second->getId(), "13_1_1");
 }
 
+TEST(ThreadPoolTest, NestedGroups){
+    ThreadPool pool(2);
+    std::atomic<int> counter{0};
+    TaskGroup outer(pool);
+    for(int i = 0; i < 4; ++i){
+        outer.run([&]{
+            TaskGroup inner(pool);
+            for(int j = 0; j < 8; ++j){
+                inner.run([&]{ ++counter; });
+            }
+            inner.wait();
+        });
+    }
+    outer.wait();
+    EXPECT_EQ(counter.load(), 32);
+    TaskGroup failing(pool);
+    failing.run([]{ throw std::runtime_error("task failed"); });
+    EXPECT_THROW(failing.wait(), std::runtime_error);
+    EXPECT_TRUE(failing.claim());
+    EXPECT_FALSE(failing.claim());
+}
+
+TEST(ThreadPoolTest, FindFirstIsDeterministic){
+    ThreadPool pool(4);
+    for(int run = 0; run < 20; ++run){
+        size_t first = findFirst(pool, 100000, 64, [](size_t i){
+            return i % 4099 == 4098 || i == 90000;
+        });
+        EXPECT_EQ(first, 4098);
+    }
+    EXPECT_EQ(findFirst(pool, 1000, 64, [](size_t){ return false; }), 1000);
+    // From inside the pool the search stays on the calling worker. The task is
+    // submitted directly, not through a TaskGroup, so this thread never runs it.
+    std::atomic<bool> sameThread{true};
+    std::promise<void> finished;
+    std::future<void> done = finished.get_future();
+    pool.submit([&]{
+        std::thread::id self = std::this_thread::get_id();
+        size_t first = findFirst(pool, 10000, 64, [&](size_t i){
+            if(std::this_thread::get_id() != self){
+                sameThread.store(false);
+            }
+            return i == 5000;
+        });
+        EXPECT_EQ(first, 5000);
+        finished.set_value();
+    });
+    done.wait();
+    EXPECT_TRUE(sameThread.load());
+}
+
 //TerminalTest----------------------------------------------------------------------------------------------------------------------------------------
 
 TEST(AddTerminalTest, Success) {
@@ -490,6 +829,380 @@ TEST(OctreeTest, TestRemove) {
     EXPECT_NO_THROW(octree.search(Point<int>(4, 4, 4)));
 }
 
+TEST(OctreeTest, TestAnchorIndexAfterSplit) {
+    Octree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(32, 32, 16))
+    );
+    std::vector<Point<int>> anchors;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            anchors.push_back(Point<int>(1 + i * 7, 1 + j * 7, 1));
+            EXPECT_TRUE(octree.push(std::make_shared<Container>("_", "Cargo A", 2, 2, 2, 23.5, 2.5), anchors.back()));
+        }
+    }
+    for (auto& anchor : anchors) {
+        EXPECT_EQ(octree.search(anchor).first.LLDown, anchor);
+    }
+    for (size_t i = 0; i < anchors.size(); i += 2) {
+        EXPECT_TRUE(octree.remove(anchors[i]));
+        EXPECT_FALSE(octree.remove(anchors[i]));
+    }
+    for (size_t i = 0; i < anchors.size(); ++i) {
+        if (i % 2 == 0) {
+            EXPECT_THROW(octree.search(anchors[i]), std::invalid_argument);
+        } else {
+            EXPECT_EQ(octree.search(anchors[i]).first.LLDown, anchors[i]);
+        }
+    }
+    EXPECT_EQ(octree.searchDepth().size(), anchors.size() / 2);
+}
+
+TEST(OctreeTest, TestNodeArena) {
+    Octree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(32, 32, 16))
+    );
+    EXPECT_EQ(octree.nodeCount(), 8);
+    std::vector<Point<int>> anchors;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            anchors.push_back(Point<int>(1 + i * 10, 1 + j * 10, 1));
+            octree.push(std::make_shared<Container>("_", "Cargo A", 2, 2, 2, 23.5, 2.5), anchors.back());
+        }
+    }
+    EXPECT_GT(octree.nodeCount(), 8);
+    auto copy = octree;
+    for (auto& anchor : anchors) {
+        EXPECT_TRUE(copy.remove(anchor));
+    }
+    EXPECT_EQ(copy.nodeCount(), 8);
+    for (auto& anchor : anchors) {
+        EXPECT_NO_THROW(octree.search(anchor));
+    }
+    EXPECT_EQ(octree.searchDepth().size(), anchors.size());
+}
+
+TEST(OctreeTest, TestCompactBounds) {
+    using Tree = Octree<Point<int>, std::shared_ptr<Container>>;
+    auto container = std::make_shared<Container>("_", "Cargo A", 3, 2, 4, 23.5, 2.5);
+    BoundingBox<Point<int>> bounds = Tree::calculateBounds(2, 5, 1, container);
+    EXPECT_EQ(bounds.min, Point<int>(2, 5, 1));
+    EXPECT_EQ(bounds.max, Point<int>(5, 7, 5));
+    EXPECT_TRUE(Tree::positionOf(bounds) == Tree::calculateContainerPosition(2, 5, 1, container));
+
+    Tree octree(BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(16, 16, 8)));
+    octree.push(container, Point<int>(2, 5, 1));
+    EXPECT_TRUE(octree.search(Point<int>(2, 5, 1)).first == Tree::calculateContainerPosition(2, 5, 1, container));
+}
+
+TEST(OctreeTest, TestOverlapKernel) {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> coord(0, 40);
+    std::uniform_int_distribution<int> size(0, 10);
+    int coords[6][OVERLAP_BLOCK];
+    for (size_t i = 0; i < OVERLAP_BLOCK; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            coords[axis][i] = coord(gen);
+            coords[axis + 3][i] = coords[axis][i] + size(gen);
+        }
+    }
+    OverlapBoxes boxes{coords[0], coords[1], coords[2], coords[3], coords[4], coords[5]};
+    for (int round = 0; round < 200; ++round) {
+        OverlapQuery query{coord(gen), coord(gen), coord(gen), 0, 0, 0};
+        query.maxX = query.minX + size(gen);
+        query.maxY = query.minY + size(gen);
+        query.maxZ = query.minZ + size(gen);
+        for (size_t count : {size_t(0), size_t(5), size_t(13), OVERLAP_BLOCK}) {
+            std::uint64_t expected = 0;
+            for (size_t i = 0; i < count; ++i) {
+                BoundingBox<Point<int>> box(Point<int>(coords[0][i], coords[1][i], coords[2][i]), Point<int>(coords[3][i], coords[4][i], coords[5][i]));
+                BoundingBox<Point<int>> q(Point<int>(query.minX, query.minY, query.minZ), Point<int>(query.maxX, query.maxY, query.maxZ));
+                expected |= static_cast<std::uint64_t>(box.intersects(q)) << i;
+            }
+            EXPECT_EQ(overlapMaskScalar(boxes, count, query), expected);
+            EXPECT_EQ(overlapMask(boxes, count, query), expected);
+#ifdef OVERLAP_KERNEL_X86
+            EXPECT_EQ(overlapMaskSSE2(boxes, count, query), expected);
+            if (__builtin_cpu_supports("avx2")) {
+                EXPECT_EQ(overlapMaskAVX2(boxes, count, query), expected);
+            }
+#endif
+        }
+    }
+}
+
+TEST(OctreeTest, TestNodeItems) {
+    NodeItems<Point<int>, int> items;
+    items.push_back(BoundingBox<Point<int>>(Point<int>(1, 1, 1), Point<int>(2, 2, 2)), 10);
+    items.push_back(BoundingBox<Point<int>>(Point<int>(5, 1, 1), Point<int>(6, 2, 2)), 20);
+    items.push_back(BoundingBox<Point<int>>(Point<int>(9, 1, 1), Point<int>(10, 2, 2)), 30);
+    EXPECT_TRUE(items.intersects(1, BoundingBox<Point<int>>(Point<int>(6, 2, 2), Point<int>(8, 8, 8))));
+    EXPECT_FALSE(items.intersects(0, BoundingBox<Point<int>>(Point<int>(3, 1, 1), Point<int>(8, 8, 8))));
+    EXPECT_EQ(overlapMask(items.overlapBoxes(0), items.size(), OverlapQuery{2, 1, 1, 5, 1, 1}), 0b011u);
+    items.eraseSwap(0);
+    ASSERT_EQ(items.size(), 2);
+    EXPECT_EQ(items.anchor(0), Point<int>(9, 1, 1));
+    EXPECT_EQ(items.payload(0), 30);
+    int sum = 0;
+    for (auto item : items) {
+        sum += item.second;
+    }
+    EXPECT_EQ(sum, 50);
+}
+
+TEST(OctreeTest, TestLooseOctree) {
+    BoundingBox<Point<int>> bounds(Point<int>(0, 0, 0), Point<int>(32, 32, 16));
+    Octree<Point<int>, std::shared_ptr<Container>> tight(bounds);
+    Octree<Point<int>, std::shared_ptr<Container>> loose(bounds, 2.0);
+    EXPECT_THROW((Octree<Point<int>, std::shared_ptr<Container>>(bounds, 0.5)), std::invalid_argument);
+    for (int j = 0; j < 6; ++j) {
+        // Every container crosses the x = 16 midplane.
+        EXPECT_TRUE(tight.push(std::make_shared<Container>("_", "Cargo A", 2, 2, 2, 23.5, 2.5), Point<int>(15, 1 + j * 4, 1)));
+        EXPECT_TRUE(loose.push(std::make_shared<Container>("_", "Cargo A", 2, 2, 2, 23.5, 2.5), Point<int>(15, 1 + j * 4, 1)));
+    }
+    EXPECT_EQ(tight.getRoot()->con.size(), 6);
+    EXPECT_EQ(loose.getRoot()->con.size(), 0);
+    EXPECT_TRUE(loose.checkCollisions(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 23.5, 2.5), Point<int>(16, 2, 2)));
+    EXPECT_FALSE(loose.checkCollisions(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 23.5, 2.5), Point<int>(18, 2, 2)));
+    int found = 0;
+    loose.queryRange(BoundingBox<Point<int>>(Point<int>(17, 0, 0), Point<int>(17, 32, 16)),
+        [&](const BoundingBox<Point<int>>&, const std::shared_ptr<Container>&){
+            ++found;
+            return true;
+        });
+    EXPECT_EQ(found, 6);
+    EXPECT_EQ(loose.Clone().getLooseness(), 2.0);
+}
+
+TEST(OctreeTest, TestBulkLoad) {
+    using Tree = Octree<Point<int>, std::shared_ptr<Container>>;
+    Tree octree(BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(64, 64, 16)), 2.0);
+    std::vector<Tree::Item> items;
+    for (int x = 1; x < 60; x += 5) {
+        for (int y = 1; y < 60; y += 5) {
+            for (int z = 1; z < 12; z += 5) {
+                auto container = std::make_shared<Container>("_", "Cargo A", 2, 2, 2, 23.5, 2.5);
+                items.emplace_back(Tree::calculateBounds(x, y, z, container), container);
+            }
+        }
+    }
+    octree.bulkLoad(items);
+    EXPECT_EQ(octree.searchDepth().size(), items.size());
+    EXPECT_GT(octree.nodeCount(), 8);
+    EXPECT_LE(octree.getRoot()->con.size(), OctreePolicy<>::leafCapacity);
+    for (const auto& item : items) {
+        EXPECT_EQ(octree.search(item.first.min).second, item.second);
+    }
+    auto probe = std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 23.5, 2.5);
+    EXPECT_TRUE(octree.checkCollisions(probe, Point<int>(2, 2, 2)));
+    EXPECT_FALSE(octree.checkCollisions(probe, Point<int>(4, 4, 4)));
+    EXPECT_TRUE(octree.remove(Point<int>(1, 1, 1)));
+    EXPECT_TRUE(octree.push(probe, Point<int>(1, 1, 1)));
+    EXPECT_EQ(octree.searchDepth().size(), items.size());
+}
+
+TEST(OctreeTest, TestLinearLayoutMatchesPointerLayout) {
+    BoundingBox<Point<int>> bounds(Point<int>(0, 0, 0), Point<int>(40, 30, 20));
+    Octree<Point<int>, std::shared_ptr<Container>> pointer(bounds);
+    Octree<Point<int>, std::shared_ptr<Container>, LinearLayout> linear(bounds);
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<int> coord(1, 36);
+    std::uniform_int_distribution<int> size(1, 4);
+    std::vector<Point<int>> anchors;
+    for (int i = 0; i < 300; ++i) {
+        auto container = std::make_shared<Container>("_", "Cargo A", size(gen), size(gen), size(gen), 23.5, 2.5);
+        Point<int> p(coord(gen), coord(gen) % 26 + 1, coord(gen) % 16 + 1);
+        bool pushed = pointer.push(container, p);
+        EXPECT_EQ(linear.push(container, p), pushed);
+        if (pushed) {
+            anchors.push_back(p);
+        }
+    }
+    EXPECT_EQ(linear.size(), anchors.size());
+    for (size_t i = 0; i < anchors.size(); i += 3) {
+        EXPECT_TRUE(linear.remove(anchors[i]));
+        EXPECT_TRUE(pointer.remove(anchors[i]));
+        EXPECT_FALSE(linear.remove(anchors[i]));
+    }
+    for (size_t i = 0; i < anchors.size(); ++i) {
+        if (i % 3 == 0) {
+            EXPECT_THROW(linear.search(anchors[i]), std::invalid_argument);
+        } else {
+            EXPECT_EQ(linear.search(anchors[i]).second, pointer.search(anchors[i]).second);
+        }
+    }
+    auto probe = std::make_shared<Container>("_", "Cargo A", 2, 2, 2, 23.5, 2.5);
+    for (int i = 0; i < 300; ++i) {
+        Point<int> p(coord(gen), coord(gen) % 26 + 1, coord(gen) % 16 + 1);
+        EXPECT_EQ(linear.checkCollisions(probe, p), pointer.checkCollisions(probe, p));
+    }
+    EXPECT_EQ(linear.searchDepth().size(), pointer.searchDepth().size());
+}
+
+TEST(OctreeTest, TestCloneIsIndependent) {
+    Octree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(32, 32, 16))
+    );
+    std::vector<Point<int>> anchors;
+    for (int i = 0; i < 5; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            anchors.push_back(Point<int>(1 + i * 6, 1 + j * 6, 1));
+            octree.push(std::make_shared<Container>("_", "Cargo A", 2, 2, 2, 23.5, 2.5), anchors.back());
+        }
+    }
+    auto clone = octree.Clone();
+    EXPECT_EQ(clone.searchDepth().size(), anchors.size());
+    EXPECT_TRUE(clone.remove(anchors[0]));
+    EXPECT_TRUE(clone.push(std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5), Point<int>(4, 4, 4)));
+    EXPECT_TRUE(octree.remove(anchors[1]));
+    EXPECT_NO_THROW(octree.search(anchors[0]));
+    EXPECT_THROW(octree.search(Point<int>(4, 4, 4)), std::invalid_argument);
+    EXPECT_THROW(clone.search(anchors[0]), std::invalid_argument);
+    EXPECT_NO_THROW(clone.search(anchors[1]));
+    EXPECT_EQ(octree.searchDepth().size(), anchors.size() - 1);
+    EXPECT_EQ(clone.searchDepth().size(), anchors.size());
+    auto removed = clone.search(anchors[2]).second;
+    EXPECT_TRUE(clone.remove(anchors[2]));
+    clone.restore(removed, anchors[2]);
+    EXPECT_EQ(clone.search(anchors[2]).second, removed);
+    EXPECT_THROW(clone.restore(removed, Point<int>(40, 1, 1)), std::logic_error);
+}
+
+TEST(OctreeTest, TestCloneCopiesTouchedBlocks) {
+    Octree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(256, 256, 256))
+    );
+    for (int i = 0; i < 60; ++i) {
+        for (int j = 0; j < 60; ++j) {
+            octree.push(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 23.5, 2.5), Point<int>(1 + i * 4, 1 + j * 4, 5));
+        }
+    }
+    ASSERT_GT(octree.nodeCount(), 512);
+    auto clone = octree.Clone();
+    size_t before = clone.copiedNodes();
+    EXPECT_TRUE(clone.push(std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5), Point<int>(2, 2, 10)));
+    size_t copied = clone.copiedNodes() - before;
+    // Only the blocks on the path to the new item are copied.
+    EXPECT_GT(copied, 0);
+    EXPECT_EQ(copied % 8, 0);
+    EXPECT_LE(copied, 8 * 12);
+    EXPECT_EQ(octree.copiedNodes(), before);
+    EXPECT_THROW(octree.search(Point<int>(2, 2, 10)), std::invalid_argument);
+}
+
+TEST(OctreeTest, TestConcurrentOctree) {
+    ConcurrentOctree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(64, 64, 8)), 4
+    );
+    EXPECT_EQ(octree.regionCount(), 16);
+    // A box crossing the border between regions goes to the spanning tree and still blocks both sides.
+    EXPECT_TRUE(octree.push(std::make_shared<Container>("_", "Cargo A", 4, 4, 1, 23.5, 2.5), Point<int>(14, 14, 1)));
+    EXPECT_FALSE(octree.push(std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5), Point<int>(17, 17, 1)));
+    EXPECT_FALSE(octree.push(std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5), Point<int>(13, 13, 1)));
+    EXPECT_NO_THROW(octree.search(Point<int>(14, 14, 1)));
+    EXPECT_TRUE(octree.remove(Point<int>(14, 14, 1)));
+    EXPECT_TRUE(octree.push(std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5), Point<int>(17, 17, 1)));
+    EXPECT_TRUE(octree.remove(Point<int>(17, 17, 1)));
+
+    // Every thread loads its own quarter and all of them race for the same shared spots.
+    std::atomic<int> contested{0};
+    std::vector<std::thread> cranes;
+    for (int t = 0; t < 4; ++t) {
+        cranes.emplace_back([&, t]{
+            int baseX = (t % 2) * 32, baseY = (t / 2) * 32;
+            for (int i = 0; i < 10; ++i) {
+                for (int j = 0; j < 10; ++j) {
+                    octree.push(std::make_shared<Container>("_", "Cargo", 1, 1, 1, 23.5, 2.5), Point<int>(baseX + 1 + i * 3, baseY + 1 + j * 3, 1));
+                }
+                if (octree.push(std::make_shared<Container>("_", "Cargo", 2, 2, 1, 23.5, 2.5), Point<int>(31 + i % 2, 31, 5))) {
+                    ++contested;
+                }
+            }
+        });
+    }
+    for (auto& crane : cranes) {
+        crane.join();
+    }
+    EXPECT_EQ(contested.load(), 1);
+    EXPECT_EQ(octree.size(), 401);
+    EXPECT_EQ(octree.searchDepth().size(), 401);
+    EXPECT_TRUE(octree.checkCollisions(std::make_shared<Container>("_", "Cargo", 1, 1, 1, 23.5, 2.5), Point<int>(33, 33, 1)));
+}
+
+TEST(OctreeTest, TestItemIterator) {
+    Octree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(64, 64, 16))
+    );
+    EXPECT_TRUE(octree.items().begin() == octree.items().end());
+    for (int i = 0; i < 10; ++i) {
+        for (int j = 0; j < 10; ++j) {
+            octree.push(std::make_shared<Container>("_", i == 7 && j == 3 ? "Needle" : "Cargo", 2, 2, 2, 23.5, 2.5), Point<int>(1 + i * 6, 1 + j * 6, 1));
+        }
+    }
+    ASSERT_GT(octree.nodeCount(), 8);
+    auto depth = octree.searchDepth();
+    size_t index = 0;
+    for (const auto& item : octree.items()) {
+        ASSERT_LT(index, depth.size());
+        EXPECT_EQ(item.first.min, depth[index].first.LLDown);
+        EXPECT_EQ(item.second, depth[index].second);
+        ++index;
+    }
+    EXPECT_EQ(index, 100);
+    auto range = octree.items();
+    EXPECT_EQ(std::distance(range.begin(), range.end()), 100);
+    auto needle = std::find_if(range.begin(), range.end(), [](const auto& item){
+        return item.second->getClient() == "Needle";
+    });
+    ASSERT_TRUE(needle != range.end());
+    EXPECT_EQ((*needle).first.min, Point<int>(43, 19, 1));
+    Octree<Point<int>, std::shared_ptr<Container>> empty;
+    EXPECT_TRUE(empty.items().begin() == empty.items().end());
+}
+
+TEST(OctreeTest, TestPolicies) {
+    BoundingBox<Point<int>> bounds(Point<int>(0, 0, 0), Point<int>(128, 128, 16));
+    Octree<Point<int>, std::shared_ptr<Container>> midpoint(bounds);
+    Octree<Point<int>, std::shared_ptr<Container>, PointerLayout, OctreePolicy<8, 1, SplitRule::Median>> median(bounds);
+    Octree<Point<int>, std::shared_ptr<Container>, PointerLayout, OctreePolicy<64>> wide(bounds);
+    // Everything is packed into one corner, so the median plane lands far from the midpoint.
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            auto container = std::make_shared<Container>("_", "Cargo", 2, 2, 2, 23.5, 2.5);
+            Point<int> p(1 + i * 4, 1 + j * 4, 1);
+            EXPECT_TRUE(midpoint.push(container, p));
+            EXPECT_TRUE(median.push(container, p));
+            EXPECT_TRUE(wide.push(container, p));
+        }
+    }
+    EXPECT_EQ(wide.nodeCount(), 8);
+    EXPECT_EQ(wide.getRoot()->con.size(), 36);
+    ASSERT_FALSE(median.getRoot()->isLeaf());
+    auto node = median.cbegin();
+    ++node;
+    EXPECT_LT((*node)->box.max.x, 64);
+    auto other = midpoint.cbegin();
+    ++other;
+    EXPECT_EQ((*other)->box.max.x, 64);
+    BoundingBox<Point<int>> query(Point<int>(5, 5, 1), Point<int>(14, 14, 2));
+    auto collect = [&](const auto& octree) {
+        std::vector<Point<int>> found;
+        octree.queryRange(query, [&](const BoundingBox<Point<int>>& box, const std::shared_ptr<Container>&) {
+            found.push_back(box.min);
+            return true;
+        });
+        std::sort(found.begin(), found.end(), [](const Point<int>& a, const Point<int>& b) {
+            return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+        });
+        return found;
+    };
+    EXPECT_EQ(collect(median), collect(midpoint));
+    EXPECT_EQ(collect(wide), collect(midpoint));
+    EXPECT_EQ(collect(midpoint).size(), 9);
+    EXPECT_FALSE(median.push(std::make_shared<Container>("_", "Cargo", 2, 2, 2, 23.5, 2.5), Point<int>(6, 6, 2)));
+    EXPECT_TRUE(median.remove(Point<int>(5, 5, 1)));
+    EXPECT_TRUE(median.push(std::make_shared<Container>("_", "Cargo", 2, 2, 2, 23.5, 2.5), Point<int>(6, 6, 2)));
+}
+
 // Тест на поиск
 TEST(OctreeTest, TestSearch) {
     Octree<Point<int>, std::shared_ptr<Container>> octree(
@@ -537,6 +1250,48 @@ TEST(OctreeTest, TestSearchDepth) {
 }
 
 
+TEST(OctreeTest, TestQueryRange) {
+    Octree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(16, 16, 8))
+    );
+    octree.push(std::make_shared<Container>("_1", "Cargo A", 2, 2, 1, 23.5, 2.5), Point<int>(1, 1, 1));
+    octree.push(std::make_shared<Container>("_2", "Cargo B", 2, 2, 1, 23.5, 2.5), Point<int>(1, 1, 3));
+    octree.push(std::make_shared<Container>("_3", "Cargo C", 2, 2, 1, 23.5, 2.5), Point<int>(10, 10, 1));
+    octree.push(std::make_shared<Container>("_4", "Cargo D", 1, 1, 1, 23.5, 2.5), Point<int>(12, 1, 5));
+    octree.push(std::make_shared<Container>("_5", "Cargo E", 1, 1, 1, 23.5, 2.5), Point<int>(5, 5, 5));
+
+    std::vector<std::string> found;
+    octree.queryRange(BoundingBox<Point<int>>(Point<int>(1, 1, 0), Point<int>(3, 3, 8)),
+        [&](const BoundingBox<Point<int>>&, const std::shared_ptr<Container>& c){
+            found.push_back(c->getId());
+            return true;
+        });
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(found, (std::vector<std::string>{"_1", "_2"}));
+
+    size_t visited = 0;
+    EXPECT_FALSE(octree.queryRange(octree.getBounds(),
+        [&](const BoundingBox<Point<int>>&, const std::shared_ptr<Container>&){
+            ++visited;
+            return false;
+        }));
+    EXPECT_EQ(visited, 1);
+}
+
+TEST(OctreeTest, TestCheckCollisions) {
+    Octree<Point<int>, std::shared_ptr<Container>> octree(
+        BoundingBox<Point<int>>(Point<int>(0, 0, 0), Point<int>(16, 16, 8))
+    );
+    for(int x = 1; x < 14; x += 3){
+        octree.push(std::make_shared<Container>("_", "Cargo A", 1, 1, 1, 23.5, 2.5), Point<int>(x, 1, 1));
+    }
+    auto probe = std::make_shared<Container>("_", "Cargo B", 1, 1, 1, 23.5, 2.5);
+    EXPECT_TRUE(octree.checkCollisions(probe, Point<int>(2, 1, 1)));
+    EXPECT_TRUE(octree.checkCollisions(probe, Point<int>(13, 2, 2)));
+    EXPECT_FALSE(octree.checkCollisions(probe, Point<int>(3, 3, 1)));
+    EXPECT_TRUE(octree.checkCollisions(probe, Point<int>(15, 1, 1)));
+}
+
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);